@@ -0,0 +1,34 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ObjectId.h"
+
+/** Helpers shared by the on-disk binary formats (commit-graph, pack
+ *  index, ...).  Integers are always stored little-endian and object
+ *  ids as 20 raw bytes. */
+namespace BinaryFormat {
+    const size_t RAW_ID_SIZE = ObjectId::SIZE;
+
+    inline uint32_t get32(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline uint64_t get64(const unsigned char* p) {
+        return static_cast<uint64_t>(get32(p)) | (static_cast<uint64_t>(get32(p + 4)) << 32);
+    }
+
+    inline void put32(std::string& out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+
+    inline void put64(std::string& out, uint64_t v) {
+        put32(out, static_cast<uint32_t>(v));
+        put32(out, static_cast<uint32_t>(v >> 32));
+    }
+}
+
+#endif // BINARY_FORMAT_H
@@ -0,0 +1,106 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ObjectStore.h"
+#include "Tree.h"
+
+/** Read-only view of a parsed commit object.
+ *
+ * A commit is stored as text:
+ *   message
+ *   first parent id, or 0 for the initial commit
+ *   [second parent id, merge commits only]
+ *   timestamp ("Thu Jan 01 00:00:00 1970 +0000")
+ *   "tree <root tree id>"
+ *
+ * Commits written before trees existed list their files inline instead
+ * of the tree line ("number of files", then "<blob id> <filename>" per
+ * file); the initial commit still uses that form with no files, so its
+ * id is the same in every repository.  Both forms are read.
+ *
+ * The Commit owns the raw bytes and every text accessor returns a view
+ * into them, so parsing allocates nothing per field; blob and tree ids
+ * are decoded to ObjectIds.  For tree commits the file list is only
+ * flattened out of the trees on the first call to files(), so walking
+ * history never reads a tree.  The file list is kept sorted by
+ * filename for binary-search lookups, and is allocated from the memory
+ * resource the commit was parsed with (the command's arena). */
+class Commit {
+public:
+    struct File {
+        ObjectId blob;
+        std::string_view filename;
+    };
+    typedef std::pmr::vector<File> FileList;
+
+    static std::shared_ptr<const Commit> parse(
+        const std::string& id, std::string content, const ObjectStore* objects = nullptr,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    static std::string format(const std::string& message, const std::string& parent1,
+                              const std::string& parent2, const std::string& timestamp,
+                              const ObjectId& tree);
+    static std::time_t parseTimestamp(std::string_view timestamp);
+    static bool parseDate(std::string_view text, std::time_t& time);
+
+    Commit(const Commit&) = delete;
+    Commit& operator=(const Commit&) = delete;
+
+    const std::string& id() const { return commitId; }
+    std::string_view message() const { return messageView; }
+    std::string_view parent1() const { return parent1View; }
+    std::string_view parent2() const { return parent2View; }
+    std::string_view timestamp() const { return timestampView; }
+    std::time_t time() const { return parseTimestamp(timestampView); }
+    bool isMerge() const { return !parent2View.empty(); }
+    const ObjectId& tree() const { return treeId; }
+
+    const FileList& files() const;
+    const File* findFile(std::string_view filename) const;
+    std::map<std::string, ObjectId> fileMap() const;
+
+private:
+    Commit(const std::string& id, std::string content, const ObjectStore* objects,
+           std::pmr::memory_resource* resource);
+    bool parseContent();
+    void loadTreeFiles() const;
+
+    std::string commitId;
+    std::string content;
+    const ObjectStore* objects;
+    std::string_view messageView;
+    std::string_view parent1View;
+    std::string_view parent2View;
+    std::string_view timestampView;
+    ObjectId treeId;
+
+    // Tree commits flatten their files on first use; views point into treeFiles.
+    mutable std::once_flag treeFilesLoaded;
+    mutable Tree::FileList treeFiles;
+    mutable FileList fileList;
+};
+
+/** Per-process cache of parsed commits keyed by id, so each commit
+ *  object is read and parsed at most once per command. */
+class CommitCache {
+public:
+    explicit CommitCache(const ObjectStore& objects,
+                         std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    std::shared_ptr<const Commit> get(const std::string& id);
+
+private:
+    const ObjectStore& objects;
+    std::pmr::memory_resource* resource;
+    std::unordered_map<std::string, std::shared_ptr<const Commit>> cache;
+};
+
+#endif // COMMIT_H
@@ -0,0 +1,124 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ObjectStore.h"
+#include "Utils.h"
+
+/** Binary, memory-mapped summary of every commit in an object store.
+ *
+ * The file objects/info/commit-graph holds the commit ids in sorted
+ * order (with a 256-entry fan-out table over the first byte), and for
+ * each commit the positions of its parents, its commit time and its
+ * generation number (1 for root commits, otherwise one more than the
+ * largest parent generation), followed by every position ordered from
+ * newest to oldest commit time.  History walks read only this file and
+ * never open loose objects.
+ *
+ * New commits do not rewrite that file.  They go to a small layer,
+ * objects/info/commit-graph-layer, that names the base it extends by
+ * its stamp and commit count.  Layer commits take the positions after
+ * the base's, so callers see a single graph.  Adding commits rewrites
+ * only the layer; once it would hold more than MAX_LAYER_COMMITS, or on
+ * compact() (run by repack), both are merged into a new base.  A layer
+ * that does not match its base makes the graph unloadable, so it is
+ * rebuilt.
+ *
+ * Layout (all integers little-endian):
+ *   "GLCG" | version u32 | count u32 | stamp u32
+ *   fanout[256] u32            number of ids whose first byte <= i
+ *   ids[count][20]             raw SHA-1, ascending
+ *   records[count]             parent1 u32 | parent2 u32 | generation u32
+ *                              | reserved u32 | time i64
+ *   byTime[count] u32          positions, newest first; ties by generation
+ *                              (descending), then position
+ *
+ * Layer layout:
+ *   "GLCL" | version u32 | count u32 | base stamp u32 | base count u32
+ *   ids[count][20]             raw SHA-1, ascending
+ *   records[count]             as above; parent positions may be in the base
+ *   byTime[count] u32          positions, ordered as above
+ */
+class CommitGraph {
+public:
+    static const uint32_t NONE = 0xffffffff;
+    static const uint32_t MAX_LAYER_COMMITS = 1024;
+
+    /** A commit as read from a loose object, used to extend the graph. */
+    struct Record {
+        ObjectId id;
+        ObjectId parent1;
+        ObjectId parent2;
+        std::time_t time = 0;
+        std::string message;
+    };
+
+    explicit CommitGraph(const ObjectStore& objects);
+    ~CommitGraph();
+
+    CommitGraph(const CommitGraph&) = delete;
+    CommitGraph& operator=(const CommitGraph&) = delete;
+
+    bool load();
+    void ensureLoaded();
+    void rebuild();
+    void addCommits(const std::vector<std::string>& ids);
+    void compact();
+
+    uint32_t size() const { return count; }
+    std::string id(uint32_t index) const;
+    ObjectId objectId(uint32_t index) const;
+    bool find(const std::string& id, uint32_t& index) const;
+    bool find(const ObjectId& id, uint32_t& index) const;
+    int findPrefix(std::string_view prefix, uint32_t& index) const;
+    uint32_t parent(uint32_t index, int which) const;
+    uint32_t generation(uint32_t index) const;
+    std::time_t commitTime(uint32_t index) const;
+    uint32_t byTime(uint32_t rank) const;
+    uint32_t firstRankUntil(std::time_t until) const;
+    std::vector<std::string> allIds() const;
+
+    uint32_t mergeBase(uint32_t a, uint32_t b) const;
+    bool isAncestor(uint32_t ancestor, uint32_t descendant) const;
+
+    static bool readRecord(const ObjectStore& objects, const ObjectId& id, Record& record);
+
+private:
+    const ObjectStore& objects;
+    std::string graphPath;
+    std::string layerPath;
+    bool loaded = false;
+
+    // mmap of the base graph file
+    MappedFile file;
+    uint32_t count = 0;
+    uint32_t baseCount = 0;
+    const unsigned char* fanout = nullptr;
+    const unsigned char* ids = nullptr;
+    const unsigned char* records = nullptr;
+    const unsigned char* timeOrder = nullptr;
+
+    // mmap of the layer, holding positions [baseCount, count)
+    MappedFile layerFile;
+    const unsigned char* layerIds = nullptr;
+    const unsigned char* layerRecords = nullptr;
+    const unsigned char* layerTimeOrder = nullptr;
+
+    void unmap();
+    bool loadLayer(uint32_t stamp);
+    void write(std::vector<Record>& commits);
+    void writeLayer(std::vector<Record>& commits);
+    std::vector<Record> decodeAll() const;
+    std::vector<Record> decodeLayer() const;
+    const unsigned char* rawId(uint32_t index) const;
+    const unsigned char* record(uint32_t index) const;
+    bool findInBase(const unsigned char* key, uint32_t& index) const;
+    bool findInLayer(const unsigned char* key, uint32_t& index) const;
+    bool newer(uint32_t a, uint32_t b) const;
+};
+
+#endif // COMMIT_GRAPH_H
@@ -0,0 +1,21 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <cstddef>
+#include <string>
+
+/** Binary deltas between two versions of an object.
+ *
+ * A delta is a header (base size, result size; both LEB128 varints)
+ * followed by instructions:
+ *   0x01..0x7f  insert: the next N bytes of the delta are copied as-is
+ *   0x80        copy:   varint offset, varint length from the base
+ * Matching uses a rolling hash over 16-byte windows of the target
+ * against an index of the base's aligned 16-byte blocks, so appending
+ * to a file produces a single copy followed by one insert run. */
+namespace Delta {
+    std::string encode(const std::string& base, const std::string& target);
+    bool apply(const std::string& base, const char* delta, size_t length, std::string& result);
+}
+
+#endif // DELTA_H
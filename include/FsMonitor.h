@@ -0,0 +1,39 @@
+#ifndef FS_MONITOR_H
+#define FS_MONITOR_H
+
+#include <string>
+#include <vector>
+
+/** Optional background process that watches the working tree with
+ *  inotify and answers "what changed since token T?" over the Unix
+ *  socket .gitlite/fsmonitor.sock.
+ *
+ * The daemon puts a watch on every directory the scan would visit (dot
+ * names and nested repositories are skipped) and records, for each path
+ * that saw an event, the sequence number of its latest change.  A token
+ * is "<instance>:<sequence>"; tokens from an earlier instance, and every
+ * token after the kernel's event queue overflowed, are answered with
+ * "rescan everything".  A changed directory is reported as the directory
+ * itself, and the caller rescans it.
+ *
+ * inotify delivers events asynchronously.  To answer a query, the daemon
+ * first creates a cookie file in .gitlite and reads events until the
+ * cookie's own event arrives.  Every change made before the query is
+ * therefore already recorded when the answer is sent.
+ *
+ * Protocol: the client sends "query <token>\n" and reads, up to EOF, the
+ * new token on the first line and then either "*" (rescan) or one
+ * changed path per line.  "stop\n" makes the daemon exit. */
+class FsMonitor {
+public:
+    enum class Answer { UNAVAILABLE, RESCAN, CHANGES };
+
+    static Answer query(const std::string& gitliteDir, const std::string& token,
+                        std::string& newToken, std::vector<std::string>& changed);
+    static bool isRunning(const std::string& gitliteDir);
+    static void start(const std::string& gitliteDir);
+    static bool stop(const std::string& gitliteDir);
+    static void run(const std::string& gitliteDir);
+};
+
+#endif // FS_MONITOR_H
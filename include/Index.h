@@ -0,0 +1,140 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <vector>
+#include "ObjectId.h"
+#include "ThreadPool.h"
+#include "WorkTree.h"
+
+/** The staging area and a stat cache of the working tree, stored in the
+ *  binary file .gitlite/index.
+ *
+ * Besides the files staged for addition and removal, the index
+ * remembers for every working file it has hashed the blob id together
+ * with the file's size, mtime and ctime (in nanoseconds), inode and
+ * mode.  hashFile() returns the remembered id without reading the file
+ * when all of those still match, so status and add only rehash files
+ * that were touched since.
+ *
+ * A file modified within the same timestamp tick in which it was hashed
+ * keeps the same stat data ("racy" timestamps).  Entries whose mtime or
+ * ctime is not strictly older than the clock reading taken just before
+ * they were stat'ed are therefore never trusted: they are rehashed every
+ * time until the file is old enough.
+ *
+ * When a file system monitor is running, the index also keeps the last
+ * token it handed out and the list of working files as of that token, so
+ * the next command only has to look at the paths changed since.  Without
+ * one, it keeps the directory listings of the last full scan (the
+ * untracked cache, see WorkTree).
+ *
+ * add and rm do not rewrite the index.  They append their changes, one
+ * record each, to .gitlite/index.journal, which load() replays on top of
+ * the index.  The journal names the generation of the index it extends
+ * and is ignored if that does not match.  Once the journal outgrows half
+ * the index, the next append() compacts both into a new index instead,
+ * so a long series of adds stays linear.
+ *
+ * The stat cache is allocated from the memory resource given to the
+ * constructor, normally the command's arena.  hashFiles() reads it from
+ * worker threads but only the calling thread ever adds to it.
+ *
+ * Layout (all integers little-endian):
+ *   "GLIX" | version u32 | staged u32 | removed u32 | cached u32
+ *   staged[]     path length u32 | path | blob[20]
+ *   removed[]    path length u32 | path
+ *   cached[]     path length u32 | path | blob[20] | size u64 | mtime i64
+ *                | ctime i64 | inode u64 | mode u32
+ *   token length u32 | token | listed u32       (version 2)
+ *   listed[]     path length u32 | path         (empty without a token)
+ *   directories u32                              (version 3)
+ *   directories[] path length u32 | path | mtime i64 | ctime i64
+ *                | inode u64 | nested u32 | files u32 | file names
+ *                | subdirectories u32 | subdirectory names
+ *   generation u64                               (version 4)
+ *
+ * Journal layout:
+ *   "GLIJ" | version u32 | generation u64
+ *   records[]    op u8 | path length u32 | path | blob[20] (stage, cache)
+ *                | size u64 | mtime i64 | ctime i64 | inode u64 | mode u32
+ *                                                          (cache only)
+ * Each section is sorted by path. */
+class Index {
+public:
+    struct Stat {
+        uint64_t size = 0;
+        int64_t mtimeNs = 0;
+        int64_t ctimeNs = 0;
+        uint64_t inode = 0;
+        uint32_t mode = 0;
+
+        bool operator==(const Stat& other) const {
+            return size == other.size && mtimeNs == other.mtimeNs && ctimeNs == other.ctimeNs &&
+                   inode == other.inode && mode == other.mode;
+        }
+    };
+
+    explicit Index(const std::string& repositoryDir,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    void load(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed);
+    void save(const std::map<std::string, ObjectId>& staged, const std::set<std::string>& removed);
+    void append(const std::map<std::string, ObjectId>& staged, const std::set<std::string>& removed);
+
+    void journalStage(const std::string& path, const ObjectId& blob);
+    void journalUnstage(const std::string& path);
+    void journalRemove(const std::string& path);
+    void journalUnremove(const std::string& path);
+    bool changed() const { return dirty || directories.changed; }
+
+    ObjectId hashFile(const std::string& path, bool unchanged = false);
+    std::vector<ObjectId> hashFiles(const std::vector<std::string>& paths, ThreadPool& pool,
+                                    const std::set<std::string>* changed = nullptr);
+    void retain(const std::set<std::string>& paths);
+    void invalidate(const std::string& path);
+    void revalidate();
+
+    const std::string& monitorToken() const { return token; }
+    void setMonitorToken(const std::string& newToken);
+    std::set<std::string>& workingFiles() { return listing; }
+    WorkTree::DirectoryCache& untrackedCache() { return directories; }
+
+    static bool statFile(const char* path, Stat& stat);
+
+private:
+    struct CacheEntry {
+        ObjectId blob;
+        Stat stat;
+    };
+
+    std::string indexPath;
+    std::string journalPath;
+    std::string legacyPath;
+    std::pmr::map<std::pmr::string, CacheEntry, std::less<>> cache;
+    std::string token;
+    std::set<std::string> listing;
+    WorkTree::DirectoryCache directories;
+    bool dirty = false;
+
+    uint64_t generation = 0;
+    size_t snapshotSize = 0;
+    size_t journalSize = 0;
+    std::string pending;         // journal records not yet appended
+    bool needsSnapshot = false;  // changes the journal cannot express
+
+    CacheEntry& cacheEntry(std::string_view path);
+    bool uncache(std::string_view path);
+    bool cached(const std::string& path, const Stat& stat, ObjectId& blob) const;
+    void remember(const std::string& path, const Stat& stat, const ObjectId& blob, int64_t startNs);
+    void loadLegacy(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed);
+    void replayJournal(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed);
+    void journal(unsigned char op, const std::string& path, const ObjectId* blob = nullptr,
+                 const Stat* stat = nullptr);
+};
+
+#endif // INDEX_H
@@ -0,0 +1,120 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+#include "ObjectId.h"
+
+class Commit;
+
+typedef uint32_t PathId;
+
+/** Interns paths: every distinct path is stored once and named by a
+ *  small integer id, so manifests of different commits can compare
+ *  paths by id.
+ *
+ * The bytes live in large blocks that never move, and the lookup table
+ * is open addressing over a flat vector of ids, so interning the paths of
+ * a large commit costs a few allocations in total rather than one per
+ * path.  All of them come from RESOURCE, normally the command's arena. */
+class PathTable {
+public:
+    explicit PathTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    ~PathTable();
+
+    PathTable(const PathTable&) = delete;
+    PathTable& operator=(const PathTable&) = delete;
+
+    PathId intern(std::string_view path);
+    std::string_view operator[](PathId id) const { return paths[id]; }
+    size_t size() const { return paths.size(); }
+    std::pmr::memory_resource* resource() const { return memory; }
+
+    /** Path order: ids are equal exactly when the paths are. */
+    bool less(PathId a, PathId b) const { return a != b && paths[a] < paths[b]; }
+
+private:
+    static constexpr PathId EMPTY = UINT32_MAX;
+
+    struct Block {
+        char* data;
+        size_t capacity;
+    };
+
+    std::pmr::memory_resource* memory;
+    std::pmr::vector<Block> blocks;
+    size_t blockUsed;
+    std::pmr::vector<std::string_view> paths;
+    std::pmr::vector<PathId> slots;
+
+    std::string_view store(std::string_view path);
+    void grow();
+};
+
+/** The files of a commit as a flat vector of (path id, blob id) sorted
+ *  by path.  A null blob id means "absent".
+ *
+ * Comparing manifests is a linear merge-join over contiguous entries
+ * instead of a lookup per file in a node-based map. */
+class Manifest {
+public:
+    struct Entry {
+        PathId path;
+        ObjectId blob;
+    };
+
+    /** A path whose blob differs between two commits. */
+    struct Change {
+        PathId path;
+        ObjectId from;
+        ObjectId to;
+    };
+    typedef std::pmr::vector<Change> Changes;
+
+    explicit Manifest(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : entries(resource) {}
+
+    static Manifest of(const Commit* commit, PathTable& paths);
+
+    /** Appends an entry; entries must be added in path order. */
+    void add(PathId path, const ObjectId& blob) { entries.push_back({path, blob}); }
+    void reserve(size_t count) { entries.reserve(count); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    std::pmr::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+    std::pmr::vector<Entry>::const_iterator end() const { return entries.end(); }
+    const Entry& operator[](size_t i) const { return entries[i]; }
+
+    /** Walks A, B and C in path order and calls VISIT(path, blobA, blobB,
+     *  blobC) once for every path in any of them, with a null id for the
+     *  manifests that do not list it. */
+    template <class Visit>
+    static void join(const PathTable& paths, const Manifest& a, const Manifest& b,
+                     const Manifest& c, Visit&& visit) {
+        static const ObjectId none;
+        size_t i = 0, j = 0, k = 0;
+        while (i < a.size() || j < b.size() || k < c.size()) {
+            PathId next = UINT32_MAX;
+            auto consider = [&](const Manifest& m, size_t at) {
+                if (at < m.size() && (next == UINT32_MAX || paths.less(m[at].path, next))) {
+                    next = m[at].path;
+                }
+            };
+            consider(a, i);
+            consider(b, j);
+            consider(c, k);
+            const ObjectId& blobA = (i < a.size() && a[i].path == next) ? a[i++].blob : none;
+            const ObjectId& blobB = (j < b.size() && b[j].path == next) ? b[j++].blob : none;
+            const ObjectId& blobC = (k < c.size() && c[k].path == next) ? c[k++].blob : none;
+            visit(next, blobA, blobB, blobC);
+        }
+    }
+
+private:
+    std::pmr::vector<Entry> entries;
+};
+
+#endif // MANIFEST_H
@@ -0,0 +1,85 @@
+#ifndef MESSAGE_INDEX_H
+#define MESSAGE_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ObjectStore.h"
+#include "Utils.h"
+
+class CommitGraph;
+
+/** Memory-mapped index of commit messages, so find reads only the
+ *  commits it reports.
+ *
+ * objects/info/message-index holds every indexed commit's id and
+ * message, an open-addressing hash table over the messages for exact
+ * lookups, and a trigram index for substring lookups: for each
+ * three-byte sequence, the ascending positions of the commits whose
+ * message contains it.  A substring query intersects the lists of its
+ * trigrams, starting from the shortest, and checks each survivor
+ * against the message text.  Queries shorter than three bytes scan the
+ * message text instead, which still opens no objects.
+ *
+ * The commit graph keeps the index current.  New commits are appended
+ * to objects/info/message-index.log, which every lookup also scans.
+ * Once the log outgrows a quarter of the index, the next addition
+ * merges both into a new index.
+ *
+ * Layout (all integers little-endian):
+ *   "GLMI" | version u32 | count u32 | slots u32 | trigrams u32 | postings u32
+ *   ids[count][20]
+ *   messages[count]    offset u32 | length u32      into text
+ *   slots[slots] u32   commit position, or NONE for an empty slot
+ *   trigrams[trigrams] key u32 | first u32 | postings u32, ascending by key
+ *   postings[] u32     commit positions, ascending within each trigram
+ *   text               the messages, concatenated
+ *
+ * Log records: id[20] | length u32 | message. */
+class MessageIndex {
+public:
+    struct Entry {
+        ObjectId id;
+        std::string message;
+    };
+
+    explicit MessageIndex(const ObjectStore& objects);
+
+    MessageIndex(const MessageIndex&) = delete;
+    MessageIndex& operator=(const MessageIndex&) = delete;
+
+    bool load();
+    void ensureLoaded(const CommitGraph& graph);
+    void rebuild(std::vector<Entry> entries);
+    void add(const std::vector<Entry>& entries);
+
+    std::vector<ObjectId> exact(std::string_view message) const;
+    std::vector<ObjectId> substring(std::string_view text) const;
+
+private:
+    const ObjectStore& objects;
+    std::string indexPath;
+    std::string logPath;
+    bool loaded = false;
+
+    MappedFile file;
+    uint32_t count = 0;
+    uint32_t slotCount = 0;
+    uint32_t trigramCount = 0;
+    const unsigned char* ids = nullptr;
+    const unsigned char* messages = nullptr;
+    const unsigned char* slots = nullptr;
+    const unsigned char* trigrams = nullptr;
+    const unsigned char* postings = nullptr;
+    const char* text = nullptr;
+    size_t textSize = 0;
+
+    ObjectId idAt(uint32_t position) const;
+    std::string_view messageAt(uint32_t position) const;
+    bool postingsOf(uint32_t key, const unsigned char*& first, uint32_t& length) const;
+    std::vector<Entry> readLog() const;
+    std::vector<Entry> decodeAll() const;
+};
+
+#endif // MESSAGE_INDEX_H
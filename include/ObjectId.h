@@ -0,0 +1,118 @@
+#ifndef OBJECT_ID_H
+#define OBJECT_ID_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace ObjectIdTables {
+    inline constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    /** Maps a character to its value as a lowercase hex digit, or -1. */
+    constexpr std::array<signed char, 256> makeHexValues() {
+        std::array<signed char, 256> values{};
+        for (int c = 0; c < 256; ++c) values[c] = -1;
+        for (int d = 0; d < 10; ++d) values['0' + d] = static_cast<signed char>(d);
+        for (int d = 0; d < 6; ++d) values['a' + d] = static_cast<signed char>(10 + d);
+        return values;
+    }
+
+    inline constexpr std::array<signed char, 256> HEX_VALUES = makeHexValues();
+}
+
+/** A SHA-1 object id held as its 20 raw bytes.
+ *
+ * ObjectId is trivially copyable and compares with memcmp, so sets and
+ * maps of ids cost no allocation and a fixed 20-byte comparison.  Ids
+ * are only spelled as 40 lowercase hex characters where text is needed:
+ * in object contents, loose object filenames and command output.  The
+ * hex encode and decode tables are built at compile time.
+ *
+ * A default-constructed ObjectId is all zeros and stands for "none". */
+class ObjectId {
+public:
+    static constexpr size_t SIZE = 20;
+    static constexpr size_t HEX_SIZE = 2 * SIZE;
+
+    constexpr ObjectId() : bytes{} {}
+
+    static ObjectId fromRaw(const unsigned char* raw) {
+        ObjectId id;
+        std::memcpy(id.bytes.data(), raw, SIZE);
+        return id;
+    }
+
+    /** Decodes the 40-char lowercase hex id HEX into ID.  Returns false,
+     *  leaving ID unspecified, if HEX is not such an id. */
+    static bool fromHex(std::string_view hex, ObjectId& id) {
+        if (hex.size() != HEX_SIZE) return false;
+        for (size_t i = 0; i < SIZE; ++i) {
+            int high = ObjectIdTables::HEX_VALUES[static_cast<unsigned char>(hex[2 * i])];
+            int low = ObjectIdTables::HEX_VALUES[static_cast<unsigned char>(hex[2 * i + 1])];
+            if (high < 0 || low < 0) return false;
+            id.bytes[i] = static_cast<unsigned char>((high << 4) | low);
+        }
+        return true;
+    }
+
+    /** Returns the id spelled by HEX, or the null id if HEX is not one. */
+    static ObjectId fromHex(std::string_view hex) {
+        ObjectId id;
+        return fromHex(hex, id) ? id : ObjectId();
+    }
+
+    const unsigned char* data() const { return bytes.data(); }
+    unsigned char* data() { return bytes.data(); }
+    bool isNull() const { return *this == ObjectId(); }
+    explicit operator bool() const { return !isNull(); }
+
+    /** Writes the 40 hex characters of this id to OUT (no terminator). */
+    void toHex(char* out) const {
+        for (size_t i = 0; i < SIZE; ++i) {
+            out[2 * i] = ObjectIdTables::HEX_DIGITS[bytes[i] >> 4];
+            out[2 * i + 1] = ObjectIdTables::HEX_DIGITS[bytes[i] & 0xf];
+        }
+    }
+
+    std::string hex() const {
+        std::string out(HEX_SIZE, '0');
+        toHex(&out[0]);
+        return out;
+    }
+
+    void appendHex(std::string& out) const {
+        size_t start = out.size();
+        out.resize(start + HEX_SIZE);
+        toHex(&out[start]);
+    }
+
+    friend bool operator==(const ObjectId& a, const ObjectId& b) {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), SIZE) == 0;
+    }
+    friend bool operator!=(const ObjectId& a, const ObjectId& b) { return !(a == b); }
+    friend bool operator<(const ObjectId& a, const ObjectId& b) {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), SIZE) < 0;
+    }
+
+private:
+    std::array<unsigned char, SIZE> bytes;
+};
+
+namespace std {
+    /** SHA-1 output is uniformly distributed, so the leading bytes are
+     *  already a good hash. */
+    template <>
+    struct hash<ObjectId> {
+        size_t operator()(const ObjectId& id) const {
+            size_t h;
+            std::memcpy(&h, id.data(), sizeof(h));
+            return h;
+        }
+    };
+}
+
+#endif // OBJECT_ID_H
@@ -0,0 +1,62 @@
+#ifndef OBJECT_STORE_H
+#define OBJECT_STORE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ObjectId.h"
+
+class PackFile;
+
+/** Content-addressed object storage under a .gitlite/objects directory.
+ *
+ * Objects live in a two-character fan-out layout, objects/ab/cdef..., so
+ * no single directory grows beyond 1/256th of the store.  repack() moves
+ * them into memory-mapped packs under objects/pack/; contains() and
+ * read() consult the packs first and fall back to loose files, so
+ * callers never need to know where an object lives.  New objects are
+ * always written loose.
+ *
+ * Objects are addressed by ObjectId.  The overloads taking a hex string
+ * are for ids that arrive as text (refs, commit parents, command
+ * arguments); a string that is not a full id names no object. */
+class ObjectStore {
+public:
+    explicit ObjectStore(const std::string& objectsDir);
+
+    const std::string& directory() const { return objectsDir; }
+    std::string path(const ObjectId& id) const;
+    bool contains(const ObjectId& id) const;
+    std::string read(const ObjectId& id) const;
+    void copyTo(const ObjectId& id, const std::string& target) const;
+    void write(const ObjectId& id, const std::string& content) const;
+    void writeFromFile(const ObjectId& id, const std::string& source) const;
+
+    std::string path(const std::string& id) const;
+    bool contains(const std::string& id) const;
+    std::string read(const std::string& id) const;
+    void write(const std::string& id, const std::string& content) const;
+
+    std::vector<ObjectId> allIds() const;
+    std::vector<ObjectId> looseIds() const;
+
+    void repack(const std::vector<ObjectId>& preferredOrder,
+                const std::map<ObjectId, ObjectId>& deltaBases = {});
+
+    void initLayout() const;
+    void migrateLayout() const;
+
+    static bool isObjectId(std::string_view name);
+
+private:
+    std::string objectsDir;
+    std::vector<std::shared_ptr<const PackFile>> packs;
+
+    std::string layoutMarkerPath() const;
+    std::string packDirectory() const;
+    void loadPacks();
+};
+
+#endif // OBJECT_STORE_H
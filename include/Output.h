@@ -0,0 +1,45 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include "ObjectId.h"
+
+/** Buffered standard output.
+ *
+ * Everything a command prints goes through Output::standard(), which
+ * collects it in one large buffer and hands it to file descriptor 1 in
+ * big writes: when the buffer fills, and once when the command ends
+ * (main and Utils::exitWithMessage call flush()).  Ids and numbers are
+ * rendered straight into the buffer, so printing a commit builds no
+ * temporary strings. */
+class Output {
+public:
+    static Output& standard();
+    ~Output();
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    Output& operator<<(std::string_view text);
+    Output& operator<<(char c);
+    Output& operator<<(const ObjectId& id);
+    Output& operator<<(int64_t value);
+
+    void flush();
+
+private:
+    static const size_t CAPACITY = 256 * 1024;
+
+    explicit Output(int fd);
+
+    int fd;
+    std::unique_ptr<char[]> buffer;
+    size_t used = 0;
+
+    void writeAll(const char* data, size_t length);
+};
+
+#endif // OUTPUT_H
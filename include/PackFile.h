@@ -0,0 +1,93 @@
+#ifndef PACK_FILE_H
+#define PACK_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ObjectId.h"
+#include "Utils.h"
+
+/** A read-only, memory-mapped pack of objects.
+ *
+ * A pack is a pair of files in objects/pack/:
+ *
+ *   pack-<name>.pack   "GLPK" | version u32 | count u32 | reserved u32
+ *                      then one entry per object:
+ *                      kind u32 | depth u32 | size u64 | size bytes
+ *                      where kind 1 stores the object whole and kind 2
+ *                      stores base id[20] followed by a Delta against
+ *                      that base (another object in the same pack)
+ *
+ *   pack-<name>.idx    "GLPI" | version u32 | count u32 | reserved u32
+ *                      fanout[256] u32    number of ids whose first byte <= i
+ *                      ids[count][20]     raw SHA-1, ascending
+ *                      offsets[count] u64 entry position in the .pack
+ *
+ * Lookups binary-search the index within the fan-out bucket of the
+ * id's first byte, so finding an object touches no inode at all.  The
+ * .idx is written last and renamed into place, so a pack without an
+ * index is never read.
+ *
+ * Delta chains are at most MAX_DELTA_DEPTH long.  Objects rebuilt while
+ * resolving a chain are kept in a small per-pack cache, so reading
+ * several versions of one file does not unpack the same bases again. */
+class PackFile {
+public:
+    typedef std::function<std::string(const ObjectId&)> Loader;
+
+    static const uint32_t MAX_DELTA_DEPTH = 50;
+
+    static std::shared_ptr<const PackFile> open(const std::string& indexPath);
+    static std::string write(const std::string& packDir, const std::vector<ObjectId>& ids,
+                             const Loader& load,
+                             const std::map<ObjectId, ObjectId>& deltaBases = {});
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    const std::string& packPath() const { return packFilePath; }
+    const std::string& indexPath() const { return indexFilePath; }
+
+    uint32_t size() const { return count; }
+    ObjectId id(uint32_t index) const;
+    bool find(const ObjectId& id, uint32_t& index) const;
+    bool contains(const ObjectId& id) const;
+    bool view(const ObjectId& id, std::string_view& content) const;
+    bool read(const ObjectId& id, std::string& content) const;
+    std::vector<ObjectId> allIds() const;
+
+private:
+    PackFile() = default;
+
+    bool findRaw(const unsigned char* key, uint32_t& index) const;
+    bool readEntry(uint64_t offset, std::string& content) const;
+    void cacheBase(uint64_t offset, const std::string& content) const;
+
+    std::string packFilePath;
+    std::string indexFilePath;
+
+    MappedFile indexFile;
+    MappedFile packFile;
+    size_t packSize = 0;
+
+    uint32_t count = 0;
+    const unsigned char* fanout = nullptr;
+    const unsigned char* ids = nullptr;
+    const unsigned char* offsets = nullptr;
+    const unsigned char* packData = nullptr;
+
+    // Recently rebuilt delta bases, keyed by entry offset.
+    mutable std::mutex cacheMutex;
+    mutable std::map<uint64_t, std::string> baseCache;
+    mutable std::deque<uint64_t> baseCacheOrder;
+    mutable size_t baseCacheBytes = 0;
+};
+
+#endif // PACK_FILE_H
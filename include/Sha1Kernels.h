@@ -0,0 +1,25 @@
+#ifndef SHA1_KERNELS_H
+#define SHA1_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SHA1 {
+    /** Compresses COUNT consecutive 64-byte BLOCKS into the five-word
+     *  chaining STATE (A..E).  Every kernel produces bit-identical
+     *  results; they differ only in the instructions they use. */
+    typedef void (*CompressFn)(uint32_t state[5], const uint8_t* blocks, size_t count);
+
+    void compressPortable(uint32_t state[5], const uint8_t* blocks, size_t count);
+#if defined(__x86_64__) || defined(__i386__)
+    void compressSsse3(uint32_t state[5], const uint8_t* blocks, size_t count);
+    void compressShaNi(uint32_t state[5], const uint8_t* blocks, size_t count);
+#endif
+
+    /** Returns the fastest kernel supported by the running CPU, chosen
+     *  once via cpuid.  Setting GITLITE_SHA1_KERNEL to "portable",
+     *  "ssse3" or "shani" forces a specific (supported) kernel. */
+    CompressFn selectCompress();
+}
+
+#endif // SHA1_KERNELS_H
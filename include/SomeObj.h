@@ -1,6 +1,8 @@
 #ifndef SOMEOBJ_H
 #define SOMEOBJ_H
 
+#include <cstddef>
+#include <ctime>
 #include <string>
 #include <vector>
 #include <memory>
@@ -13,14 +15,16 @@ public:
     // Subtask1
     void init();
     void add(const std::string& filename);
+    void add(const std::vector<std::string>& paths);
     void commit(const std::string& message);
     void rm(const std::string& filename);
     
     // Subtask2
     void status();
-    void log();
-    void globalLog();
-    void find(const std::string& commitMessage);
+    void log(const std::string& format = "");
+    void globalLog(size_t limit, std::time_t since, std::time_t until,
+                   const std::string& format = "");
+    void find(const std::string& commitMessage, bool substring = false);
     void checkoutFile(const std::string& filename);
     void checkoutFileInCommit(const std::string& commitId, const std::string& filename);
     
@@ -36,6 +40,10 @@ public:
     void fetch(const std::string& remoteName, const std::string& branchName);
     void pull(const std::string& remoteName, const std::string& branchName);
     
+    // 仓库维护
+    void repack();
+    void fsmonitor(const std::string& action);
+    
 private:
     class Impl;
     std::unique_ptr<Impl> pImpl;
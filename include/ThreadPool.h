@@ -0,0 +1,67 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/** A fixed-size pool of worker threads draining a shared task queue.
+ *  The first exception raised by any task is captured and rethrown
+ *  from wait(). */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = defaultThreadCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static size_t defaultThreadCount();
+    size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task);
+    void wait();
+
+    /** Runs BODY(i) for every i in [0, COUNT) across the pool and
+     *  returns once all calls have finished.  Indices are handed out
+     *  dynamically so uneven work (large vs small files) balances. */
+    template <class Body>
+    void parallelFor(size_t count, Body&& body) {
+        if (count == 0) return;
+        if (workers.size() <= 1 || count == 1) {
+            for (size_t i = 0; i < count; ++i) body(i);
+            return;
+        }
+        std::atomic<size_t> next(0);
+        size_t lanes = std::min(workers.size(), count);
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            submit([&next, count, &body]() {
+                for (size_t i = next++; i < count; i = next++) {
+                    body(i);
+                }
+            });
+        }
+        wait();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    size_t pending = 0;
+    bool stopping = false;
+    std::exception_ptr firstError;
+
+    void workerLoop();
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,31 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <string>
+#include <vector>
+
+/** Makes the files written by one command durable together.
+ *
+ * Every file write is already atomic (Utils::writeContents renames a
+ * temporary file into place) but is not flushed.  A command records the
+ * objects it wrote or depends on with add(), and then moves a ref with
+ * updateRef().  That first flushes the whole batch with one syncfs() of
+ * the repository's filesystem, so the cost does not grow with the number
+ * of objects.  Where syncfs() is unavailable, each recorded file and
+ * each directory holding one is fsync'd instead.  Only then is the ref
+ * written and fsync'd, so a ref never points at an object that could be
+ * lost in a crash. */
+class Transaction {
+public:
+    explicit Transaction(const std::string& repositoryDir);
+
+    void add(const std::string& path);
+    void commit();
+    void updateRef(const std::string& refPath, const std::string& commitId);
+
+private:
+    std::string repositoryDir;
+    std::vector<std::string> paths;
+};
+
+#endif // TRANSACTION_H
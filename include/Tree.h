@@ -0,0 +1,65 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ObjectStore.h"
+
+/** Content-addressed snapshot of one directory.
+ *
+ * A tree is stored as text:
+ *   number of entries
+ *   "blob <id> <name>" or "tree <id> <name>" per entry, sorted by name
+ *
+ * A commit names the tree of the repository root, and a subdirectory is
+ * a "tree" entry naming another tree.  Because a tree's id is the hash
+ * of its content, a commit that changes one file rewrites only the trees
+ * on that file's path; every other directory is shared with the parent
+ * commit by id, and diff() skips any subtree whose id is the same on
+ * both sides without reading it.
+ *
+ * Paths handed to and returned by these functions are relative to the
+ * root and use '/' as the separator.  A null ObjectId means "absent",
+ * both for a blob and for a tree (the empty tree). */
+class Tree {
+public:
+    struct Entry {
+        bool isTree;
+        ObjectId id;
+        std::string name;
+    };
+    typedef std::vector<Entry> Entries;
+    typedef std::pmr::vector<std::pair<std::pmr::string, ObjectId>> FileList;
+    typedef std::function<void(const std::string& path, const ObjectId& blobA,
+                               const ObjectId& blobB)> DiffCallback;
+
+    static bool parse(std::string_view content, Entries& entries);
+    static std::string format(const Entries& entries);
+
+    static Entries read(const ObjectStore& objects, const ObjectId& id);
+    static ObjectId write(const ObjectStore& objects, const Entries& entries,
+                          std::vector<ObjectId>& written);
+    static ObjectId build(const ObjectStore& objects,
+                          const std::map<std::string, ObjectId>& files,
+                          std::vector<ObjectId>& written);
+    static ObjectId update(const ObjectStore& objects, const ObjectId& rootId,
+                           const std::map<std::string, ObjectId>& changes,
+                           std::vector<ObjectId>& written);
+
+    static void flatten(const ObjectStore& objects, const ObjectId& id,
+                        const std::string& prefix, FileList& files);
+    static void diff(const ObjectStore& objects, const ObjectId& idA, const ObjectId& idB,
+                     const std::string& prefix, const DiffCallback& callback);
+    static void collect(const ObjectStore& objects, const ObjectId& id,
+                        const std::function<bool(const ObjectId& treeId)>& enter,
+                        const std::function<void(const std::string& path,
+                                                 const ObjectId& blob)>& visitBlob,
+                        const std::string& prefix = "");
+};
+
+#endif // TREE_H
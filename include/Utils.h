@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
 #include <iostream>
@@ -12,31 +13,72 @@
 #include <unistd.h>
 #include <cstdint>
 #include <iomanip>
+#include "ObjectId.h"
 
 namespace SHA1 {
+    /** Incremental SHA-1 engine.  Feed data through update() in pieces
+     *  of any size and call finalizeId() for the raw digest, or
+     *  finalize() for its 40-char hex spelling; only one 64-byte block
+     *  is ever buffered. */
     class SHA {
     private:
         typedef uint8_t BYTE;
         typedef uint32_t WORD;
-        WORD A, B, C, D, E;
-        std::vector<WORD> Word;
+        static const size_t BLOCK_SIZE = 64;
+        WORD state[5];
+        BYTE buffer[BLOCK_SIZE];
+        size_t bufferLength;
+        uint64_t totalLength;
         void reset();
-        std::string padding(std::string message);
-        inline WORD charToWord(char ch);
-        WORD shiftLeft(WORD x, int n);
-        WORD kt(int t);
-        WORD ft(int t, WORD B, WORD C, WORD D);
-        void getWord(std::string& message, int index);
     public:
         SHA();
-        std::string sha(std::string message);
+        void init();
+        void update(const void* data, size_t length);
+        void update(const std::string& data);
+        ObjectId finalizeId();
+        std::string finalize();
+        std::string sha(const std::string& message);
     };
     extern SHA sha;
-    std::string sha1(std::string message);
-    std::string sha1(std::string s1, std::string s2);
-    std::string sha1(std::string s1, std::string s2, std::string s3, std::string s4);
+    std::string sha1(const std::string& message);
+    std::string sha1(const std::string& s1, const std::string& s2);
+    std::string sha1(const std::string& s1, const std::string& s2,
+                     const std::string& s3, const std::string& s4);
 }
 
+/** Read-only view of a whole file.  Files of at least MAP_THRESHOLD
+ *  bytes are mmap'd and never copied; smaller ones are read once into an
+ *  internal buffer, which is cheaper than setting up a mapping.  Either
+ *  way view() stays valid until the MappedFile is closed or destroyed. */
+class MappedFile {
+public:
+    static const size_t MAP_THRESHOLD = 64 * 1024;
+
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filepath);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filepath);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return mapping != nullptr ? static_cast<const char*>(mapping) : buffer.data(); }
+    const unsigned char* bytes() const { return reinterpret_cast<const unsigned char*>(data()); }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(data(), length); }
+
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+    std::string buffer;
+    bool opened = false;
+};
+
 class Utils {
 public:
     static const int UID_LENGTH = 40;
@@ -47,16 +89,21 @@ public:
     static std::string sha1(const std::string& s1, const std::string& s2, 
                           const std::string& s3, const std::string& s4);
     static std::string sha1(const std::vector<unsigned char>& data);
+    static ObjectId sha1Id(std::string_view content);
+    static ObjectId sha1File(const std::string& filepath);
 
     // File operations
     static bool restrictedDelete(const std::string& filepath);
     static std::vector<unsigned char> readContents(const std::string& filepath);
     static std::string readContentsAsString(const std::string& filepath);
-    static void writeContents(const std::string& filepath, const std::string& content);
+    static void writeContents(const std::string& filepath, std::string_view content);
     static void writeContents(const std::string& filepath, const std::vector<unsigned char>& content);
+    static void copyContents(const std::string& source, const std::string& target);
 
     // Directory operations
     static std::vector<std::string> plainFilenamesIn(const std::string& dirPath);
+    static bool isGlobPattern(const std::string& path);
+    static std::vector<std::string> expandGlob(const std::string& pattern);
     static std::string join(const std::string& first, const std::string& second);
     static std::string join(const std::string& first, const std::string& second, const std::string& third);
 
@@ -0,0 +1,60 @@
+#ifndef WORK_TREE_H
+#define WORK_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+/** Paths and directory scans of the working tree.
+ *
+ * Tracked paths are relative to the repository root and use '/' as the
+ * separator ("src/main.cpp").  scan() skips names starting with '.' at
+ * any depth, and everything inside a nested repository (a subdirectory
+ * holding its own .gitlite).
+ *
+ * scan() lists every trackable file below a directory.  Each directory
+ * is one task: a task opens its directory with openat() relative to one
+ * descriptor for the scan root, reads it with getdents64() (readdir()
+ * elsewhere), records files, and pushes subdirectories onto its
+ * worker's own deque.  Workers take work from the back of their own
+ * deque and steal from the front of the others', so a wide or deep
+ * subtree discovered by one worker is spread across all of them.
+ *
+ * A scan of the root can reuse the listings of a previous scan (the
+ * untracked cache).  A directory's mtime changes whenever an entry is
+ * added, removed or renamed in it, so a directory whose mtime, ctime and
+ * inode still match its cached listing is not read again.  Only its
+ * subdirectories are visited, to check them the same way.  As with the
+ * index's stat cache, a listing is only kept when the directory's
+ * timestamps are older than the clock reading taken before the scan. */
+class WorkTree {
+public:
+    /** The entries of one directory as of its stat data. */
+    struct Listing {
+        int64_t mtimeNs = 0;
+        int64_t ctimeNs = 0;
+        uint64_t inode = 0;
+        bool nestedRepository = false;
+        std::vector<std::string> files;
+        std::vector<std::string> directories;
+    };
+
+    /** Listings by directory path ("" for the root). */
+    struct DirectoryCache {
+        std::map<std::string, Listing> listings;
+        bool changed = false;
+    };
+
+    static std::vector<std::string> scan(const std::string& directory = ".",
+                                         size_t threadCount = ThreadPool::defaultThreadCount(),
+                                         DirectoryCache* cache = nullptr);
+    static std::vector<std::string> scanPath(const std::string& path,
+                                             size_t threadCount = ThreadPool::defaultThreadCount());
+    static std::string normalize(const std::string& path);
+    static int64_t timestampClock();
+};
+
+#endif // WORK_TREE_H
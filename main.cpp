@@ -1,7 +1,10 @@
-#include <iostream>
+#include <charconv>
+#include <limits>
 #include <vector>
 #include <string>
 #include "include/SomeObj.h"
+#include "include/Commit.h"
+#include "include/Output.h"
 #include "include/Repository.h"
 #include "include/Utils.h"
 
@@ -23,6 +26,53 @@ void checkArgsNum(const std::vector<std::string>& args, int n) {
     }
 }
 
+struct LogOptions {
+    std::string format;
+    size_t limit = std::numeric_limits<size_t>::max();
+    std::time_t since = std::numeric_limits<std::time_t>::min();
+    std::time_t until = std::numeric_limits<std::time_t>::max();
+};
+
+// log [--format FORMAT]
+// global-log [-n N] [--since DATE] [--until DATE] [--format FORMAT]
+// 选项也可写成 --format=FORMAT；FILTERS 为 false 时只接受 --format
+LogOptions parseLogOptions(const std::vector<std::string>& args, bool filters) {
+    LogOptions options;
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string option = args[i];
+        std::string value;
+        size_t equals = option.find('=');
+        if (option.rfind("--", 0) == 0 && equals != std::string::npos) {
+            value = option.substr(equals + 1);
+            option = option.substr(0, equals);
+        } else if (i + 1 < args.size()) {
+            value = args[++i];
+        } else {
+            Utils::exitWithMessage("Incorrect operands.");
+        }
+        bool valid;
+        if (option == "--format") {
+            options.format = value;
+            valid = true;
+        } else if (!filters) {
+            valid = false;
+        } else if (option == "-n") {
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), options.limit);
+            valid = ec == std::errc() && ptr == value.data() + value.size();
+        } else if (option == "--since") {
+            valid = Commit::parseDate(value, options.since);
+        } else if (option == "--until") {
+            valid = Commit::parseDate(value, options.until);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            Utils::exitWithMessage("Incorrect operands.");
+        }
+    }
+    return options;
+}
+
 int main(int argc, char* argv[]) {
     std::vector<std::string> args;
     for (int i = 1; i < argc; ++i) {
@@ -46,8 +96,10 @@ int main(int argc, char* argv[]) {
         bloop.rmRemote(args[1]);
     } else if (firstArg == "add") {
         checkCWD();
-        checkArgsNum(args, 2);
-        bloop.add(args[1]);
+        if (args.size() < 2) {
+            Utils::exitWithMessage("Incorrect operands.");
+        }
+        bloop.add(std::vector<std::string>(args.begin() + 1, args.end()));
     } else if (firstArg == "commit") {
         checkCWD();
         checkArgsNum(args, 2);
@@ -58,16 +110,19 @@ int main(int argc, char* argv[]) {
         bloop.rm(args[1]);
     } else if (firstArg == "log") {
         checkCWD();
-        checkArgsNum(args, 1);
-        bloop.log();
+        bloop.log(parseLogOptions(args, false).format);
     } else if (firstArg == "global-log") {
         checkCWD();
-        checkArgsNum(args, 1);
-        bloop.globalLog();
+        LogOptions options = parseLogOptions(args, true);
+        bloop.globalLog(options.limit, options.since, options.until, options.format);
     } else if (firstArg == "find") {
         checkCWD();
-        checkArgsNum(args, 2);
-        bloop.find(args[1]);
+        if (args.size() == 3 && args[1] == "--substring") {
+            bloop.find(args[2], true);
+        } else {
+            checkArgsNum(args, 2);
+            bloop.find(args[1]);
+        }
     } else if (firstArg == "status") {
         checkCWD();
         checkArgsNum(args, 1);
@@ -117,10 +172,20 @@ int main(int argc, char* argv[]) {
         checkCWD();
         checkArgsNum(args, 3);
         bloop.pull(args[1], args[2]);
+    } else if (firstArg == "repack") {
+        checkCWD();
+        checkArgsNum(args, 1);
+        bloop.repack();
+    } else if (firstArg == "fsmonitor") {
+        checkCWD();
+        if (args.size() > 2 || (args.size() == 2 && args[1] != "--stop")) {
+            Utils::exitWithMessage("Incorrect operands.");
+        }
+        bloop.fsmonitor(args.size() == 2 ? args[1] : "");
     } else {
-        std::cout << "No command with that name exists." << std::endl;
-        return 0;
+        Utils::message("No command with that name exists.");
     }
-    
+
+    Output::standard().flush();
     return 0;
 }
@@ -0,0 +1,197 @@
+#include "../include/Commit.h"
+#include "../include/Tree.h"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <sstream>
+
+Commit::Commit(const std::string& id, std::string content, const ObjectStore* objects,
+               std::pmr::memory_resource* resource)
+    : commitId(id), content(std::move(content)), objects(objects), treeFiles(resource),
+      fileList(resource) {}
+
+/** Parses CONTENT as commit ID.  Returns null if CONTENT does not have
+ *  the commit shape (objects are untyped, so blobs are rejected here).
+ *  OBJECTS is where files() reads the commit's trees from; a commit
+ *  parsed without it can still report tree().  The file list is
+ *  allocated from RESOURCE. */
+std::shared_ptr<const Commit> Commit::parse(const std::string& id, std::string content,
+                                            const ObjectStore* objects,
+                                            std::pmr::memory_resource* resource) {
+    std::shared_ptr<Commit> commit(new Commit(id, std::move(content), objects, resource));
+    if (!commit->parseContent()) {
+        return nullptr;
+    }
+    return commit;
+}
+
+bool Commit::parseContent() {
+    std::string_view rest(content);
+    auto nextLine = [&rest](std::string_view& line) {
+        if (rest.empty()) return false;
+        size_t end = rest.find('\n');
+        line = rest.substr(0, end);
+        rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+        return true;
+    };
+
+    std::string_view line;
+    if (!nextLine(messageView) || !nextLine(line)) return false;
+    if (line != "0" && !ObjectStore::isObjectId(line)) return false;
+    parent1View = (line == "0") ? std::string_view() : line;
+
+    if (!nextLine(line)) return false;
+    if (line.find(':') == std::string_view::npos) {
+        if (!ObjectStore::isObjectId(line)) return false;
+        parent2View = line;
+        if (!nextLine(line)) return false;
+    }
+    timestampView = line;
+    if (parseTimestamp(timestampView) == -1) return false;
+
+    if (!nextLine(line)) return false;
+    if (line.substr(0, 5) == "tree ") {
+        return ObjectId::fromHex(line.substr(5), treeId) && !treeId.isNull() && rest.empty();
+    }
+    size_t fileCount = 0;
+    auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), fileCount);
+    if (ec != std::errc()) return false;
+
+    fileList.reserve(fileCount);
+    for (size_t i = 0; i < fileCount; ++i) {
+        if (!nextLine(line)) return false;
+        size_t space = line.find(' ');
+        ObjectId blob;
+        if (space == std::string_view::npos || !ObjectId::fromHex(line.substr(0, space), blob)) return false;
+        fileList.push_back({blob, line.substr(space + 1)});
+    }
+    if (!std::is_sorted(fileList.begin(), fileList.end(),
+                        [](const File& a, const File& b) { return a.filename < b.filename; })) {
+        std::sort(fileList.begin(), fileList.end(),
+                  [](const File& a, const File& b) { return a.filename < b.filename; });
+    }
+    return true;
+}
+
+/** Returns the tracked files, sorted by filename. */
+const Commit::FileList& Commit::files() const {
+    if (!treeId.isNull()) {
+        std::call_once(treeFilesLoaded, [this] { loadTreeFiles(); });
+    }
+    return fileList;
+}
+
+/** Flattens the commit's tree into treeFiles and points fileList at its
+ *  paths.  treeFiles is complete before the first view is taken and never
+ *  changes afterwards, so the views stay valid. */
+void Commit::loadTreeFiles() const {
+    if (objects == nullptr) {
+        throw std::invalid_argument("commit " + commitId + " was parsed without an object store");
+    }
+    Tree::flatten(*objects, treeId, "", treeFiles);
+
+    fileList.reserve(treeFiles.size());
+    for (const auto& [path, blob] : treeFiles) {
+        fileList.push_back({blob, std::string_view(path)});
+    }
+    if (!std::is_sorted(fileList.begin(), fileList.end(),
+                        [](const File& a, const File& b) { return a.filename < b.filename; })) {
+        std::sort(fileList.begin(), fileList.end(),
+                  [](const File& a, const File& b) { return a.filename < b.filename; });
+    }
+}
+
+/** Returns the entry for FILENAME, or null if the commit does not
+ *  track it. */
+const Commit::File* Commit::findFile(std::string_view filename) const {
+    const FileList& fileList = files();
+    auto it = std::lower_bound(fileList.begin(), fileList.end(), filename,
+                               [](const File& f, std::string_view name) { return f.filename < name; });
+    if (it == fileList.end() || it->filename != filename) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+/** Returns the tracked files as an owning filename -> blob id map. */
+std::map<std::string, ObjectId> Commit::fileMap() const {
+    std::map<std::string, ObjectId> files;
+    for (const auto& file : this->files()) {
+        files.emplace_hint(files.end(), std::string(file.filename), file.blob);
+    }
+    return files;
+}
+
+/** Serializes a commit in the format described in Commit.h.  An empty
+ *  PARENT1 is written as 0; an empty PARENT2 is omitted. */
+std::string Commit::format(const std::string& message, const std::string& parent1,
+                           const std::string& parent2, const std::string& timestamp,
+                           const ObjectId& tree) {
+    std::ostringstream out;
+    out << message << "\n";
+    out << (parent1.empty() ? "0" : parent1) << "\n";
+    if (!parent2.empty()) {
+        out << parent2 << "\n";
+    }
+    out << timestamp << "\n";
+    out << "tree " << tree.hex() << "\n";
+    return out.str();
+}
+
+/** Converts a commit timestamp ("Thu Jan 01 00:00:00 1970 +0000") to
+ *  seconds since the epoch, or -1 if it does not parse. */
+std::time_t Commit::parseTimestamp(std::string_view timestamp) {
+    std::string text(timestamp);
+    std::tm tm{};
+    if (strptime(text.c_str(), "%a %b %d %H:%M:%S %Y", &tm) == nullptr) {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+/** Parses a date given on the command line, in UTC like commit
+ *  timestamps: "@SECONDS", "YYYY-MM-DD" (midnight), "YYYY-MM-DD
+ *  HH:MM:SS", "YYYY-MM-DDTHH:MM:SS", or a commit's Date line. */
+bool Commit::parseDate(std::string_view text, std::time_t& time) {
+    if (!text.empty() && text[0] == '@') {
+        long long seconds = 0;
+        auto [ptr, ec] = std::from_chars(text.data() + 1, text.data() + text.size(), seconds);
+        if (ec != std::errc() || ptr != text.data() + text.size() || text.size() == 1) return false;
+        time = static_cast<std::time_t>(seconds);
+        return true;
+    }
+    static const char* const FORMATS[] = {
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d", "%a %b %d %H:%M:%S %Y",
+    };
+    std::string copy(text);
+    for (const char* format : FORMATS) {
+        std::tm tm{};
+        const char* end = strptime(copy.c_str(), format, &tm);
+        if (end == nullptr) continue;
+        std::string_view rest(end);
+        if (!rest.empty() && rest != " +0000") continue;
+        time = timegm(&tm);
+        return true;
+    }
+    return false;
+}
+
+CommitCache::CommitCache(const ObjectStore& objects, std::pmr::memory_resource* resource)
+    : objects(objects), resource(resource) {}
+
+/** Returns commit ID, reading and parsing it on first use.  Returns
+ *  null if no such object exists or it is not a commit. */
+std::shared_ptr<const Commit> CommitCache::get(const std::string& id) {
+    auto it = cache.find(id);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    if (id.empty() || id == "0" || !objects.contains(id)) {
+        return nullptr;
+    }
+    std::shared_ptr<const Commit> commit = Commit::parse(id, objects.read(id), &objects, resource);
+    if (commit) {
+        cache.emplace(id, commit);
+    }
+    return commit;
+}
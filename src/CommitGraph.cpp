@@ -0,0 +1,658 @@
+#include "../include/CommitGraph.h"
+#include "../include/Utils.h"
+#include "../include/Commit.h"
+#include "../include/BinaryFormat.h"
+#include "../include/MessageIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <set>
+#include <unistd.h>
+
+static const char GRAPH_MAGIC[4] = {'G', 'L', 'C', 'G'};
+static const uint32_t GRAPH_VERSION = 2;
+static const size_t HEADER_SIZE = 16;
+static const size_t FANOUT_SIZE = 256 * 4;
+static const size_t ID_SIZE = BinaryFormat::RAW_ID_SIZE;
+static const size_t RECORD_SIZE = 24;
+static const size_t ORDER_SIZE = 4;
+
+using BinaryFormat::get32;
+using BinaryFormat::get64;
+using BinaryFormat::put32;
+using BinaryFormat::put64;
+
+static const char LAYER_MAGIC[4] = {'G', 'L', 'C', 'L'};
+static const uint32_t LAYER_VERSION = 1;
+static const size_t LAYER_HEADER_SIZE = 20;
+
+namespace {
+
+uint32_t newStamp() {
+    std::random_device random;
+    uint32_t value = 0;
+    while (value == 0) {
+        value = random();
+    }
+    return value;
+}
+
+/** Generation numbers for commits whose parents are PARENTS[2i] and
+ *  PARENTS[2i+1].  Positions from OFFSET on name these commits; lower
+ *  positions name commits whose generation KNOWN returns. */
+template <class Known>
+std::vector<uint32_t> generationsOf(const std::vector<uint32_t>& parents, uint32_t offset,
+                                    Known known) {
+    uint32_t n = static_cast<uint32_t>(parents.size() / 2);
+    std::vector<uint32_t> generations(n, 0);
+    // Iterative post-order walk so every parent gets its generation first.
+    std::vector<uint32_t> stack;
+    for (uint32_t start = 0; start < n; ++start) {
+        if (generations[start] != 0) continue;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            uint32_t current = stack.back();
+            bool ready = true;
+            uint32_t gen = 1;
+            for (int k = 0; k < 2; ++k) {
+                uint32_t p = parents[2 * current + k];
+                if (p == CommitGraph::NONE) continue;
+                if (p < offset) {
+                    gen = std::max(gen, known(p) + 1);
+                } else if (generations[p - offset] == 0) {
+                    stack.push_back(p - offset);
+                    ready = false;
+                } else {
+                    gen = std::max(gen, generations[p - offset] + 1);
+                }
+            }
+            if (ready) {
+                generations[current] = gen;
+                stack.pop_back();
+            }
+        }
+    }
+    return generations;
+}
+
+/** Appends the id, record and time-order sections for COMMITS, which
+ *  take positions OFFSET onwards.  Newest first; within one second a
+ *  child (higher generation) comes before its parents, and positions
+ *  follow ids for the rest. */
+void putCommits(std::string& out, const std::vector<CommitGraph::Record>& commits,
+                const std::vector<uint32_t>& parents, const std::vector<uint32_t>& generations,
+                uint32_t offset) {
+    uint32_t n = static_cast<uint32_t>(commits.size());
+    for (uint32_t i = 0; i < n; ++i) {
+        out.append(reinterpret_cast<const char*>(commits[i].id.data()), ID_SIZE);
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        put32(out, parents[2 * i]);
+        put32(out, parents[2 * i + 1]);
+        put32(out, generations[i]);
+        put32(out, 0);
+        put64(out, static_cast<uint64_t>(static_cast<int64_t>(commits[i].time)));
+    }
+
+    std::vector<uint32_t> order(n);
+    for (uint32_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&commits, &generations](uint32_t a, uint32_t b) {
+        if (commits[a].time != commits[b].time) return commits[a].time > commits[b].time;
+        if (generations[a] != generations[b]) return generations[a] > generations[b];
+        return a < b;
+    });
+    for (uint32_t position : order) {
+        put32(out, offset + position);
+    }
+}
+
+void sortUnique(std::vector<CommitGraph::Record>& commits) {
+    std::sort(commits.begin(), commits.end(),
+              [](const CommitGraph::Record& a, const CommitGraph::Record& b) { return a.id < b.id; });
+    commits.erase(std::unique(commits.begin(), commits.end(),
+                              [](const CommitGraph::Record& a, const CommitGraph::Record& b) {
+                                  return a.id == b.id;
+                              }),
+                  commits.end());
+}
+
+/** The first position in [LO, HI) of the ascending ids at IDS whose id
+ *  is not below KEY. */
+uint32_t lowerBound(const unsigned char* ids, uint32_t lo, uint32_t hi, const unsigned char* key) {
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (std::memcmp(ids + static_cast<size_t>(mid) * ID_SIZE, key, ID_SIZE) < 0) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+} // namespace
+
+CommitGraph::CommitGraph(const ObjectStore& objects)
+    : objects(objects), graphPath(objects.directory() + "/info/commit-graph"),
+      layerPath(objects.directory() + "/info/commit-graph-layer") {}
+
+CommitGraph::~CommitGraph() {
+    unmap();
+}
+
+void CommitGraph::unmap() {
+    file.close();
+    layerFile.close();
+    count = baseCount = 0;
+    fanout = ids = records = timeOrder = nullptr;
+    layerIds = layerRecords = layerTimeOrder = nullptr;
+    loaded = false;
+}
+
+/** Maps the base graph and its layer, if any.  Returns false if either
+ *  is malformed, or the layer was written for another base. */
+bool CommitGraph::load() {
+    unmap();
+    if (!file.open(graphPath) || file.size() < HEADER_SIZE + FANOUT_SIZE) {
+        file.close();
+        return false;
+    }
+
+    const unsigned char* base = file.bytes();
+    uint32_t n = get32(base + 8);
+    if (std::memcmp(base, GRAPH_MAGIC, 4) != 0 || get32(base + 4) != GRAPH_VERSION ||
+        file.size() != HEADER_SIZE + FANOUT_SIZE + static_cast<size_t>(n) * (ID_SIZE + RECORD_SIZE + ORDER_SIZE)) {
+        file.close();
+        return false;
+    }
+
+    count = baseCount = n;
+    fanout = base + HEADER_SIZE;
+    ids = fanout + FANOUT_SIZE;
+    records = ids + static_cast<size_t>(n) * ID_SIZE;
+    timeOrder = records + static_cast<size_t>(n) * RECORD_SIZE;
+    if (!loadLayer(get32(base + 12))) {
+        unmap();
+        return false;
+    }
+    loaded = true;
+    return true;
+}
+
+/** Maps the layer on top of a base with STAMP.  A missing layer is an
+ *  empty one. */
+bool CommitGraph::loadLayer(uint32_t stamp) {
+    if (!Utils::exists(layerPath)) return true;
+    if (!layerFile.open(layerPath) || layerFile.size() < LAYER_HEADER_SIZE) return false;
+    const unsigned char* base = layerFile.bytes();
+    uint32_t n = get32(base + 8);
+    if (std::memcmp(base, LAYER_MAGIC, 4) != 0 || get32(base + 4) != LAYER_VERSION ||
+        get32(base + 12) != stamp || get32(base + 16) != baseCount ||
+        layerFile.size() != LAYER_HEADER_SIZE + static_cast<size_t>(n) * (ID_SIZE + RECORD_SIZE + ORDER_SIZE)) {
+        return false;
+    }
+    count = baseCount + n;
+    layerIds = base + LAYER_HEADER_SIZE;
+    layerRecords = layerIds + static_cast<size_t>(n) * ID_SIZE;
+    layerTimeOrder = layerRecords + static_cast<size_t>(n) * RECORD_SIZE;
+    return true;
+}
+
+/** Loads the graph, building it from the loose objects the first time a
+ *  repository without one is opened. */
+void CommitGraph::ensureLoaded() {
+    if (loaded) return;
+    if (!load()) {
+        rebuild();
+    }
+}
+
+/** Regenerates the graph, and the message index with it, from every
+ *  commit object in the store. */
+void CommitGraph::rebuild() {
+    std::vector<Record> commits;
+    for (const auto& objectId : objects.allIds()) {
+        Record record;
+        if (readRecord(objects, objectId, record)) {
+            commits.push_back(std::move(record));
+        }
+    }
+    std::vector<MessageIndex::Entry> messages;
+    messages.reserve(commits.size());
+    for (auto& record : commits) {
+        messages.push_back({record.id, std::move(record.message)});
+    }
+    write(commits);
+    load();
+    MessageIndex(objects).rebuild(std::move(messages));
+}
+
+/** Adds the commits IDS (and any of their ancestors the graph does not
+ *  know yet) and records their messages in the message index.  Only the
+ *  layer is rewritten, unless it has grown past MAX_LAYER_COMMITS. */
+void CommitGraph::addCommits(const std::vector<std::string>& newIds) {
+    ensureLoaded();
+
+    std::vector<Record> added;
+    std::set<ObjectId> seen;
+    std::vector<ObjectId> pending;
+    for (const auto& newId : newIds) {
+        pending.push_back(ObjectId::fromHex(newId));
+    }
+    while (!pending.empty()) {
+        ObjectId current = pending.back();
+        pending.pop_back();
+        uint32_t index;
+        if (current.isNull() || !seen.insert(current).second || find(current, index)) {
+            continue;
+        }
+        Record record;
+        if (!readRecord(objects, current, record)) continue;
+        pending.push_back(record.parent1);
+        pending.push_back(record.parent2);
+        added.push_back(std::move(record));
+    }
+    if (added.empty()) return;
+
+    std::vector<MessageIndex::Entry> messages;
+    messages.reserve(added.size());
+    for (auto& record : added) {
+        messages.push_back({record.id, std::move(record.message)});
+    }
+    if (count - baseCount + added.size() > MAX_LAYER_COMMITS) {
+        std::vector<Record> commits = decodeAll();
+        commits.insert(commits.end(), added.begin(), added.end());
+        write(commits);
+    } else {
+        std::vector<Record> commits = decodeLayer();
+        commits.insert(commits.end(), added.begin(), added.end());
+        writeLayer(commits);
+    }
+    load();
+    MessageIndex(objects).add(messages);
+}
+
+/** Merges the layer into a new base graph. */
+void CommitGraph::compact() {
+    ensureLoaded();
+    if (count == baseCount) return;
+    std::vector<Record> commits = decodeAll();
+    write(commits);
+    load();
+}
+
+std::vector<CommitGraph::Record> CommitGraph::decodeAll() const {
+    std::vector<Record> commits(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        commits[i].id = objectId(i);
+        uint32_t p1 = parent(i, 0), p2 = parent(i, 1);
+        if (p1 != NONE) commits[i].parent1 = objectId(p1);
+        if (p2 != NONE) commits[i].parent2 = objectId(p2);
+        commits[i].time = commitTime(i);
+    }
+    return commits;
+}
+
+std::vector<CommitGraph::Record> CommitGraph::decodeLayer() const {
+    std::vector<Record> commits(count - baseCount);
+    for (uint32_t i = baseCount; i < count; ++i) {
+        Record& commit = commits[i - baseCount];
+        commit.id = objectId(i);
+        uint32_t p1 = parent(i, 0), p2 = parent(i, 1);
+        if (p1 != NONE) commit.parent1 = objectId(p1);
+        if (p2 != NONE) commit.parent2 = objectId(p2);
+        commit.time = commitTime(i);
+    }
+    return commits;
+}
+
+/** Sorts COMMITS, resolves parents to positions, computes generation
+ *  numbers, replaces the graph file and drops the layer. */
+void CommitGraph::write(std::vector<Record>& commits) {
+    sortUnique(commits);
+
+    uint32_t n = static_cast<uint32_t>(commits.size());
+    auto indexOf = [&](const ObjectId& target) -> uint32_t {
+        if (target.isNull()) return NONE;
+        auto it = std::lower_bound(commits.begin(), commits.end(), target,
+                                   [](const Record& r, const ObjectId& t) { return r.id < t; });
+        return (it != commits.end() && it->id == target) ? static_cast<uint32_t>(it - commits.begin()) : NONE;
+    };
+
+    std::vector<uint32_t> parents(2 * static_cast<size_t>(n));
+    for (uint32_t i = 0; i < n; ++i) {
+        parents[2 * i] = indexOf(commits[i].parent1);
+        parents[2 * i + 1] = indexOf(commits[i].parent2);
+    }
+    std::vector<uint32_t> generations = generationsOf(parents, 0, [](uint32_t) { return 0u; });
+
+    std::string out;
+    out.reserve(HEADER_SIZE + FANOUT_SIZE + static_cast<size_t>(n) * (ID_SIZE + RECORD_SIZE + ORDER_SIZE));
+    out.append(GRAPH_MAGIC, 4);
+    put32(out, GRAPH_VERSION);
+    put32(out, n);
+    put32(out, newStamp());
+
+    uint32_t buckets[256] = {0};
+    for (uint32_t i = 0; i < n; ++i) {
+        buckets[commits[i].id.data()[0]]++;
+    }
+    uint32_t running = 0;
+    for (int b = 0; b < 256; ++b) {
+        running += buckets[b];
+        put32(out, running);
+    }
+    putCommits(out, commits, parents, generations, 0);
+
+    Utils::writeContents(graphPath, out);
+    unlink(layerPath.c_str());
+}
+
+/** Replaces the layer with COMMITS, none of which is in the base.
+ *  Parents resolve to layer positions first, then to base positions. */
+void CommitGraph::writeLayer(std::vector<Record>& commits) {
+    sortUnique(commits);
+
+    uint32_t n = static_cast<uint32_t>(commits.size());
+    auto indexOf = [&](const ObjectId& target) -> uint32_t {
+        if (target.isNull()) return NONE;
+        auto it = std::lower_bound(commits.begin(), commits.end(), target,
+                                   [](const Record& r, const ObjectId& t) { return r.id < t; });
+        if (it != commits.end() && it->id == target) {
+            return baseCount + static_cast<uint32_t>(it - commits.begin());
+        }
+        uint32_t index;
+        return findInBase(target.data(), index) ? index : NONE;
+    };
+
+    std::vector<uint32_t> parents(2 * static_cast<size_t>(n));
+    for (uint32_t i = 0; i < n; ++i) {
+        parents[2 * i] = indexOf(commits[i].parent1);
+        parents[2 * i + 1] = indexOf(commits[i].parent2);
+    }
+    std::vector<uint32_t> generations =
+        generationsOf(parents, baseCount, [this](uint32_t p) { return generation(p); });
+
+    std::string out;
+    out.reserve(LAYER_HEADER_SIZE + static_cast<size_t>(n) * (ID_SIZE + RECORD_SIZE + ORDER_SIZE));
+    out.append(LAYER_MAGIC, 4);
+    put32(out, LAYER_VERSION);
+    put32(out, n);
+    put32(out, get32(file.bytes() + 12));
+    put32(out, baseCount);
+    putCommits(out, commits, parents, generations, baseCount);
+
+    Utils::writeContents(layerPath, out);
+}
+
+const unsigned char* CommitGraph::rawId(uint32_t index) const {
+    return index < baseCount ? ids + static_cast<size_t>(index) * ID_SIZE
+                             : layerIds + static_cast<size_t>(index - baseCount) * ID_SIZE;
+}
+
+const unsigned char* CommitGraph::record(uint32_t index) const {
+    return index < baseCount ? records + static_cast<size_t>(index) * RECORD_SIZE
+                             : layerRecords + static_cast<size_t>(index - baseCount) * RECORD_SIZE;
+}
+
+/** Time order across base and layer: newer commit time first, then
+ *  higher generation, then smaller id. */
+bool CommitGraph::newer(uint32_t a, uint32_t b) const {
+    if (commitTime(a) != commitTime(b)) return commitTime(a) > commitTime(b);
+    if (generation(a) != generation(b)) return generation(a) > generation(b);
+    return std::memcmp(rawId(a), rawId(b), ID_SIZE) < 0;
+}
+
+/** Returns the position of the RANK-th newest commit.  Base and layer
+ *  are each in time order, so this selects the RANK-th element of their
+ *  merge: a binary search finds how many base commits precede it. */
+uint32_t CommitGraph::byTime(uint32_t rank) const {
+    uint32_t layerCount = count - baseCount;
+    auto baseAt = [this](uint32_t i) { return get32(timeOrder + ORDER_SIZE * static_cast<size_t>(i)); };
+    auto layerAt = [this](uint32_t j) { return get32(layerTimeOrder + ORDER_SIZE * static_cast<size_t>(j)); };
+    if (layerCount == 0) return baseAt(rank);
+
+    uint32_t lo = rank > layerCount ? rank - layerCount : 0;
+    uint32_t hi = std::min(rank, baseCount);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (newer(baseAt(mid), layerAt(rank - mid - 1))) lo = mid + 1; else hi = mid;
+    }
+    uint32_t j = rank - lo;
+    if (lo < baseCount && (j >= layerCount || newer(baseAt(lo), layerAt(j)))) {
+        return baseAt(lo);
+    }
+    return layerAt(j);
+}
+
+/** Returns the rank of the newest commit made at or before UNTIL, or
+ *  size() if there is none: the number of newer commits in the base
+ *  plus those in the layer. */
+uint32_t CommitGraph::firstRankUntil(std::time_t until) const {
+    auto newerThan = [this, until](const unsigned char* order, uint32_t n) {
+        uint32_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (commitTime(get32(order + ORDER_SIZE * static_cast<size_t>(mid))) > until) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    };
+    return newerThan(timeOrder, baseCount) + newerThan(layerTimeOrder, count - baseCount);
+}
+
+std::string CommitGraph::id(uint32_t index) const {
+    return objectId(index).hex();
+}
+
+ObjectId CommitGraph::objectId(uint32_t index) const {
+    return ObjectId::fromRaw(rawId(index));
+}
+
+bool CommitGraph::find(const std::string& commitId, uint32_t& index) const {
+    ObjectId key;
+    return ObjectId::fromHex(commitId, key) && find(key, index);
+}
+
+/** Looks up commit ID in the base, then in the layer. */
+bool CommitGraph::find(const ObjectId& commitId, uint32_t& index) const {
+    return findInBase(commitId.data(), index) || findInLayer(commitId.data(), index);
+}
+
+/** The fan-out table narrows the binary search to the ids sharing the
+ *  first byte of KEY. */
+bool CommitGraph::findInBase(const unsigned char* key, uint32_t& index) const {
+    if (baseCount == 0) return false;
+    uint32_t lo = key[0] == 0 ? 0 : get32(fanout + 4 * (key[0] - 1));
+    uint32_t hi = get32(fanout + 4 * key[0]);
+    uint32_t at = lowerBound(ids, lo, hi, key);
+    if (at < hi && std::memcmp(ids + static_cast<size_t>(at) * ID_SIZE, key, ID_SIZE) == 0) {
+        index = at;
+        return true;
+    }
+    return false;
+}
+
+bool CommitGraph::findInLayer(const unsigned char* key, uint32_t& index) const {
+    uint32_t layerCount = count - baseCount;
+    uint32_t at = lowerBound(layerIds, 0, layerCount, key);
+    if (at < layerCount && std::memcmp(layerIds + static_cast<size_t>(at) * ID_SIZE, key, ID_SIZE) == 0) {
+        index = baseCount + at;
+        return true;
+    }
+    return false;
+}
+
+/** Resolves an abbreviated hex id.  Returns how many commits start with
+ *  PREFIX, counting no further than 2, and sets INDEX to one of them.
+ *  The ids sharing a prefix are adjacent in the base and in the layer,
+ *  so one binary search in each for the smallest id with that prefix
+ *  finds them all. */
+int CommitGraph::findPrefix(std::string_view prefix, uint32_t& index) const {
+    if (count == 0 || prefix.empty() || prefix.size() > 2 * ID_SIZE) return 0;
+    unsigned char key[ID_SIZE] = {0};
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        int nibble = ObjectIdTables::HEX_VALUES[static_cast<unsigned char>(prefix[i])];
+        if (nibble < 0) return 0;
+        key[i / 2] |= static_cast<unsigned char>(i % 2 == 0 ? nibble << 4 : nibble);
+    }
+    auto matches = [&](const unsigned char* id) {
+        size_t whole = prefix.size() / 2;
+        if (std::memcmp(id, key, whole) != 0) return false;
+        return prefix.size() % 2 == 0 || (id[whole] & 0xf0) == key[whole];
+    };
+
+    int found = 0;
+    if (baseCount > 0) {
+        unsigned first = key[0];
+        unsigned last = prefix.size() == 1 ? (first | 0x0f) : first;
+        uint32_t lo = first == 0 ? 0 : get32(fanout + 4 * (first - 1));
+        uint32_t hi = get32(fanout + 4 * last);
+        for (uint32_t at = lowerBound(ids, lo, hi, key); at < baseCount && found < 2; ++at) {
+            if (!matches(ids + static_cast<size_t>(at) * ID_SIZE)) break;
+            if (found++ == 0) index = at;
+        }
+    }
+    uint32_t layerCount = count - baseCount;
+    for (uint32_t at = lowerBound(layerIds, 0, layerCount, key); at < layerCount && found < 2; ++at) {
+        if (!matches(layerIds + static_cast<size_t>(at) * ID_SIZE)) break;
+        if (found++ == 0) index = baseCount + at;
+    }
+    return found;
+}
+
+uint32_t CommitGraph::parent(uint32_t index, int which) const {
+    return get32(record(index) + 4 * which);
+}
+
+uint32_t CommitGraph::generation(uint32_t index) const {
+    return get32(record(index) + 8);
+}
+
+std::time_t CommitGraph::commitTime(uint32_t index) const {
+    return static_cast<std::time_t>(static_cast<int64_t>(get64(record(index) + 16)));
+}
+
+/** Returns every commit id, ascending. */
+std::vector<std::string> CommitGraph::allIds() const {
+    std::vector<std::string> result;
+    result.reserve(count);
+    uint32_t i = 0, j = baseCount;
+    while (i < baseCount || j < count) {
+        if (j == count || (i < baseCount && std::memcmp(rawId(i), rawId(j), ID_SIZE) < 0)) {
+            result.push_back(id(i++));
+        } else {
+            result.push_back(id(j++));
+        }
+    }
+    return result;
+}
+
+/** Returns the best common ancestor of commits A and B, or NONE.
+ *
+ * Both sides are painted down their history from a queue ordered by
+ * generation number (then commit time), so a commit is only popped
+ * after every path from A or B into it has been explored.  The first
+ * commit that carries both paints is therefore a common ancestor that
+ * no other common ancestor descends from; the walk finishes that
+ * generation and stops.  There is no depth limit.
+ *
+ * Criss-cross merges leave several such ancestors.  The one nearest to
+ * B in a breadth-first walk (first parents first) wins, so the choice
+ * never depends on commit ids or timestamps that share a second. */
+uint32_t CommitGraph::mergeBase(uint32_t a, uint32_t b) const {
+    if (a == b) return a;
+
+    enum : unsigned char { FROM_A = 1, FROM_B = 2 };
+    std::vector<unsigned char> paint(count, 0);
+
+    auto later = [this](uint32_t x, uint32_t y) {
+        if (generation(x) != generation(y)) return generation(x) < generation(y);
+        if (commitTime(x) != commitTime(y)) return commitTime(x) < commitTime(y);
+        return x > y;
+    };
+    std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(later)> queue(later);
+
+    paint[a] |= FROM_A;
+    paint[b] |= FROM_B;
+    queue.push(a);
+    queue.push(b);
+
+    std::vector<uint32_t> bases;
+    uint32_t baseGeneration = 0;
+    while (!queue.empty()) {
+        uint32_t current = queue.top();
+        queue.pop();
+        if (!bases.empty() && generation(current) < baseGeneration) break;
+        unsigned char flags = paint[current];
+        if (flags == (FROM_A | FROM_B)) {
+            if (std::find(bases.begin(), bases.end(), current) == bases.end()) {
+                bases.push_back(current);
+                baseGeneration = generation(current);
+            }
+            continue;
+        }
+        for (int k = 0; k < 2; ++k) {
+            uint32_t p = parent(current, k);
+            if (p == NONE || (paint[p] & flags) == flags) continue;
+            paint[p] |= flags;
+            queue.push(p);
+        }
+    }
+    if (bases.size() <= 1) {
+        return bases.empty() ? NONE : bases.front();
+    }
+
+    std::vector<bool> visited(count, false);
+    std::queue<uint32_t> nearest;
+    nearest.push(b);
+    visited[b] = true;
+    while (!nearest.empty()) {
+        uint32_t current = nearest.front();
+        nearest.pop();
+        if (std::find(bases.begin(), bases.end(), current) != bases.end()) {
+            return current;
+        }
+        for (int k = 0; k < 2; ++k) {
+            uint32_t p = parent(current, k);
+            if (p == NONE || visited[p] || generation(p) < baseGeneration) continue;
+            visited[p] = true;
+            nearest.push(p);
+        }
+    }
+    return bases.front();
+}
+
+/** Returns true if ANCESTOR is reachable from DESCENDANT.  Commits whose
+ *  generation is not above ANCESTOR's cannot lead to it, so the walk
+ *  never goes below that generation. */
+bool CommitGraph::isAncestor(uint32_t ancestor, uint32_t descendant) const {
+    uint32_t floor = generation(ancestor);
+    std::vector<bool> visited(count, false);
+    std::vector<uint32_t> stack = {descendant};
+    visited[descendant] = true;
+
+    while (!stack.empty()) {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        if (current == ancestor) return true;
+        for (int k = 0; k < 2; ++k) {
+            uint32_t p = parent(current, k);
+            if (p == NONE || visited[p] || generation(p) < floor) continue;
+            visited[p] = true;
+            stack.push_back(p);
+        }
+    }
+    return false;
+}
+
+/** Reads commit ID from OBJECTS into RECORD.  Returns false if the
+ *  object is missing or is not a commit. */
+bool CommitGraph::readRecord(const ObjectStore& objects, const ObjectId& commitId, Record& record) {
+    if (!objects.contains(commitId)) return false;
+    std::shared_ptr<const Commit> commit = Commit::parse(commitId.hex(), objects.read(commitId));
+    if (!commit) return false;
+
+    record.id = commitId;
+    record.parent1 = ObjectId::fromHex(commit->parent1());
+    record.parent2 = ObjectId::fromHex(commit->parent2());
+    record.time = commit->time();
+    record.message = std::string(commit->message());
+    return true;
+}
@@ -0,0 +1,162 @@
+#include "../include/Delta.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static const size_t BLOCK_SIZE = 16;
+static const size_t MAX_INSERT = 0x7f;
+static const unsigned char OP_COPY = 0x80;
+static const size_t MAX_PROBES = 8;
+static const uint32_t HASH_MULTIPLIER = 0x01000193;
+
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) return false;
+        unsigned char byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static uint32_t hashBlock(const unsigned char* p) {
+    uint32_t h = 0;
+    for (size_t k = 0; k < BLOCK_SIZE; ++k) {
+        h = h * HASH_MULTIPLIER + p[k];
+    }
+    return h;
+}
+
+static void putInserts(std::string& out, const std::string& target, size_t start, size_t end) {
+    while (start < end) {
+        size_t n = std::min(MAX_INSERT, end - start);
+        out.push_back(static_cast<char>(n));
+        out.append(target, start, n);
+        start += n;
+    }
+}
+
+/** Returns a delta that rebuilds TARGET from BASE. */
+std::string Delta::encode(const std::string& base, const std::string& target) {
+    std::string out;
+    putVarint(out, base.size());
+    putVarint(out, target.size());
+    if (base.size() < BLOCK_SIZE || target.size() < BLOCK_SIZE) {
+        putInserts(out, target, 0, target.size());
+        return out;
+    }
+
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(base.data());
+    const unsigned char* dst = reinterpret_cast<const unsigned char*>(target.data());
+
+    // Open-addressed table of aligned base blocks; slots hold offset + 1.
+    size_t blocks = base.size() / BLOCK_SIZE;
+    size_t slots = 1;
+    while (slots < 2 * blocks) slots <<= 1;
+    size_t mask = slots - 1;
+    std::vector<size_t> table(slots, 0);
+    for (size_t b = 0; b < blocks; ++b) {
+        uint32_t h = hashBlock(src + b * BLOCK_SIZE);
+        for (size_t k = 0; k < MAX_PROBES; ++k) {
+            size_t& slot = table[(h + k) & mask];
+            if (slot == 0) {
+                slot = b * BLOCK_SIZE + 1;
+                break;
+            }
+        }
+    }
+
+    // HASH_MULTIPLIER^(BLOCK_SIZE-1), to drop the outgoing byte.
+    uint32_t outFactor = 1;
+    for (size_t k = 1; k < BLOCK_SIZE; ++k) outFactor *= HASH_MULTIPLIER;
+
+    size_t literalStart = 0;
+    size_t i = 0;
+    uint32_t h = hashBlock(dst);
+    while (i + BLOCK_SIZE <= target.size()) {
+        size_t match = 0;
+        for (size_t k = 0; k < MAX_PROBES; ++k) {
+            size_t slot = table[(h + k) & mask];
+            if (slot == 0) break;
+            if (std::memcmp(src + slot - 1, dst + i, BLOCK_SIZE) == 0) {
+                match = slot;
+                break;
+            }
+        }
+
+        if (match == 0) {
+            if (i + BLOCK_SIZE < target.size()) {
+                h = (h - dst[i] * outFactor) * HASH_MULTIPLIER + dst[i + BLOCK_SIZE];
+            }
+            ++i;
+            continue;
+        }
+
+        // Grow the match backwards over pending literals, then forwards.
+        size_t offset = match - 1;
+        while (i > literalStart && offset > 0 && src[offset - 1] == dst[i - 1]) {
+            --i;
+            --offset;
+        }
+        size_t length = 0;
+        while (offset + length < base.size() && i + length < target.size() &&
+               src[offset + length] == dst[i + length]) {
+            ++length;
+        }
+
+        putInserts(out, target, literalStart, i);
+        out.push_back(static_cast<char>(OP_COPY));
+        putVarint(out, offset);
+        putVarint(out, length);
+        i += length;
+        literalStart = i;
+        if (i + BLOCK_SIZE <= target.size()) {
+            h = hashBlock(dst + i);
+        }
+    }
+    putInserts(out, target, literalStart, target.size());
+    return out;
+}
+
+/** Rebuilds into RESULT the object described by the LENGTH-byte DELTA
+ *  against BASE.  Returns false if the delta is malformed or was made
+ *  against a different base. */
+bool Delta::apply(const std::string& base, const char* delta, size_t length, std::string& result) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(delta);
+    const unsigned char* end = p + length;
+    uint64_t baseSize, resultSize;
+    if (!getVarint(p, end, baseSize) || !getVarint(p, end, resultSize) || baseSize != base.size()) {
+        return false;
+    }
+
+    result.clear();
+    result.reserve(static_cast<size_t>(resultSize));
+    while (p < end) {
+        unsigned char op = *p++;
+        if (op == OP_COPY) {
+            uint64_t offset, count;
+            if (!getVarint(p, end, offset) || !getVarint(p, end, count) ||
+                offset > base.size() || count > base.size() - offset) {
+                return false;
+            }
+            result.append(base, static_cast<size_t>(offset), static_cast<size_t>(count));
+        } else if (op != 0 && op <= MAX_INSERT) {
+            if (static_cast<size_t>(end - p) < op) return false;
+            result.append(reinterpret_cast<const char*>(p), op);
+            p += op;
+        } else {
+            return false;
+        }
+    }
+    return result.size() == resultSize;
+}
@@ -0,0 +1,424 @@
+#include "../include/FsMonitor.h"
+#include "../include/Utils.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <set>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#endif
+
+namespace {
+
+const char* SOCKET_NAME = "/fsmonitor.sock";
+const char* COOKIE_PREFIX = "fsmonitor-cookie-";
+
+/** Connects to the daemon of GITLITEDIR.  Returns -1 if none answers. */
+int connectTo(const std::string& gitliteDir) {
+    std::string path = gitliteDir + SOCKET_NAME;
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval timeout = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+bool sendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+/** Reads from FD until EOF, or until a newline if LINEONLY. */
+bool receive(int fd, std::string& out, bool lineOnly) {
+    char buffer[64 * 1024];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return !lineOnly;
+        out.append(buffer, static_cast<size_t>(n));
+        if (lineOnly && out.find('\n') != std::string::npos) return true;
+    }
+}
+
+/** Sends MESSAGE to the daemon and reads the whole reply. */
+bool request(const std::string& gitliteDir, const std::string& message, std::string& reply) {
+    int fd = connectTo(gitliteDir);
+    if (fd < 0) return false;
+    bool ok = sendAll(fd, message) && receive(fd, reply, false);
+    close(fd);
+    return ok;
+}
+
+#ifdef __linux__
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+class Daemon {
+public:
+    explicit Daemon(const std::string& gitliteDir) : gitliteDir(gitliteDir) {}
+    ~Daemon();
+
+    bool open();
+    void run();
+
+private:
+    std::string gitliteDir;
+    int inotifyFd = -1;
+    int listenFd = -1;
+    int repositoryWd = -1;
+    std::unordered_map<int, std::string> directories;  // watch -> directory
+    std::unordered_map<std::string, uint64_t> changedAt; // path -> sequence
+    std::set<std::string> cookiesSeen;
+    std::string instance;
+    uint64_t sequence = 0;
+    unsigned generation = 0;
+    unsigned cookieCount = 0;
+    bool reliable = true;
+    bool running = true;
+
+    void reset();
+    void watchTree(const std::string& relative);
+    void unwatchTree(const std::string& relative);
+    bool readEvents(int timeoutMs);
+    void handle(const struct inotify_event* event);
+    bool sync();
+    void serve(int client);
+    std::string answer(const std::string& token) const;
+};
+
+Daemon::~Daemon() {
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink((gitliteDir + SOCKET_NAME).c_str());
+    }
+    if (inotifyFd >= 0) close(inotifyFd);
+}
+
+/** Sets up inotify, the watches and the listening socket. */
+bool Daemon::open() {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) return false;
+    repositoryWd = inotify_add_watch(inotifyFd, gitliteDir.c_str(),
+                                     IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (repositoryWd < 0) return false;
+    reset();
+    watchTree("");
+
+    std::string path = gitliteDir + SOCKET_NAME;
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    unlink(path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return listenFd >= 0 &&
+           bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0 &&
+           listen(listenFd, 16) == 0;
+}
+
+/** Starts a new instance: every token handed out so far becomes stale. */
+void Daemon::reset() {
+    instance = std::to_string(getpid()) + "-" + std::to_string(std::time(nullptr)) + "-" +
+               std::to_string(++generation);
+    changedAt.clear();
+}
+
+/** Watches directory RELATIVE and every directory below it. */
+void Daemon::watchTree(const std::string& relative) {
+    std::string path = relative.empty() ? "." : relative;
+    int wd = inotify_add_watch(inotifyFd, path.c_str(), WATCH_MASK | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (wd < 0) {
+        // Out of watches (max_user_watches): changes could go unseen,
+        // so every query is answered with a rescan from now on.
+        if (errno != ENOENT && errno != ENOTDIR) reliable = false;
+        return;
+    }
+    directories[wd] = relative;
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) return;
+    std::string prefix = relative.empty() ? "" : relative + "/";
+    std::vector<std::string> children;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        std::string child = prefix + entry->d_name;
+        struct stat st;
+        if (entry->d_type == DT_DIR ||
+            (entry->d_type == DT_UNKNOWN && lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))) {
+            children.push_back(std::move(child));
+        }
+    }
+    closedir(dir);
+    for (const auto& child : children) {
+        if (!Utils::exists(child + "/.gitlite")) {
+            watchTree(child);
+        }
+    }
+}
+
+/** Drops the watches on RELATIVE and everything below it. */
+void Daemon::unwatchTree(const std::string& relative) {
+    std::string prefix = relative + "/";
+    for (auto it = directories.begin(); it != directories.end();) {
+        if (it->second == relative || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Daemon::handle(const struct inotify_event* event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        reset();
+        return;
+    }
+    if (event->wd == repositoryWd) {
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            running = false;
+        } else if (event->len > 0 && std::strncmp(event->name, COOKIE_PREFIX, std::strlen(COOKIE_PREFIX)) == 0) {
+            cookiesSeen.insert(event->name);
+        }
+        return;
+    }
+    auto it = directories.find(event->wd);
+    if (it == directories.end()) return;
+    if (event->mask & IN_IGNORED) {
+        directories.erase(it);
+        return;
+    }
+    std::string relative = it->second;
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (relative.empty()) {
+            running = false;
+        } else {
+            changedAt[relative] = ++sequence;
+        }
+        return;
+    }
+    if (event->len == 0 || event->name[0] == '.') return;
+
+    std::string path = relative.empty() ? event->name : relative + "/" + event->name;
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            unwatchTree(path);
+        }
+        if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !Utils::exists(path + "/.gitlite")) {
+            watchTree(path);
+        }
+    }
+    changedAt[path] = ++sequence;
+}
+
+/** Handles the queued events, waiting up to TIMEOUTMS for the first.
+ *  Returns false on timeout. */
+bool Daemon::readEvents(int timeoutMs) {
+    struct pollfd pfd = {inotifyFd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) return false;
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        ssize_t n = read(inotifyFd, buffer, sizeof(buffer));
+        if (n <= 0) return true;
+        for (ssize_t pos = 0; pos < n;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + pos);
+            handle(event);
+            pos += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+
+/** Makes sure every change made before now has been recorded, by
+ *  waiting for the event of a freshly created cookie file. */
+bool Daemon::sync() {
+    std::string name = COOKIE_PREFIX + std::to_string(getpid()) + "-" + std::to_string(++cookieCount);
+    std::string path = gitliteDir + "/" + name;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    close(fd);
+    bool seen = false;
+    while (running && !(seen = cookiesSeen.count(name) != 0)) {
+        if (!readEvents(5000)) break;
+    }
+    unlink(path.c_str());
+    cookiesSeen.erase(name);
+    return seen;
+}
+
+/** The reply to "query TOKEN". */
+std::string Daemon::answer(const std::string& token) const {
+    std::string reply = instance + ":" + std::to_string(sequence) + "\n";
+    size_t colon = token.rfind(':');
+    if (!reliable || colon == std::string::npos || token.compare(0, colon, instance) != 0) {
+        return reply + "*\n";
+    }
+    uint64_t since = std::strtoull(token.c_str() + colon + 1, nullptr, 10);
+    for (const auto& [path, changed] : changedAt) {
+        if (changed > since) {
+            reply += path;
+            reply += '\n';
+        }
+    }
+    return reply;
+}
+
+void Daemon::serve(int client) {
+    struct timeval timeout = {10, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string message;
+    if (!receive(client, message, true)) return;
+    message.resize(message.find('\n'));
+
+    if (message == "stop") {
+        sendAll(client, "ok\n");
+        running = false;
+    } else if (message.compare(0, 6, "query ") == 0) {
+        if (!sync()) {
+            sendAll(client, instance + ":" + std::to_string(sequence) + "\n*\n");
+            return;
+        }
+        sendAll(client, answer(message.substr(6)));
+    }
+}
+
+void Daemon::run() {
+    while (running) {
+        struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {listenFd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            readEvents(0);
+        }
+        if (fds[1].revents & POLLIN) {
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                serve(client);
+                close(client);
+            }
+        }
+    }
+}
+
+#endif // __linux__
+
+} // namespace
+
+/** Asks the daemon of GITLITEDIR what changed since TOKEN.  On RESCAN and
+ *  CHANGES, NEWTOKEN is the token to ask with next time; on CHANGES,
+ *  CHANGED holds the changed paths. */
+FsMonitor::Answer FsMonitor::query(const std::string& gitliteDir, const std::string& token,
+                                   std::string& newToken, std::vector<std::string>& changed) {
+    std::string reply;
+    if (!request(gitliteDir, "query " + token + "\n", reply)) {
+        return Answer::UNAVAILABLE;
+    }
+    size_t end = reply.find('\n');
+    if (end == std::string::npos || end == 0) {
+        return Answer::UNAVAILABLE;
+    }
+    newToken = reply.substr(0, end);
+    changed.clear();
+    for (size_t start = end + 1; start < reply.size();) {
+        end = reply.find('\n', start);
+        if (end == std::string::npos) end = reply.size();
+        if (reply.compare(start, end - start, "*") == 0) {
+            changed.clear();
+            return Answer::RESCAN;
+        }
+        changed.emplace_back(reply, start, end - start);
+        start = end + 1;
+    }
+    return Answer::CHANGES;
+}
+
+bool FsMonitor::isRunning(const std::string& gitliteDir) {
+    int fd = connectTo(gitliteDir);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+}
+
+/** Starts the daemon for the repository in the current directory in the
+ *  background, and returns once it accepts queries. */
+void FsMonitor::start(const std::string& gitliteDir) {
+#ifdef __linux__
+    if (isRunning(gitliteDir)) {
+        Utils::exitWithMessage("A file system monitor is already running.");
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        Utils::exitWithMessage("Cannot start the file system monitor.");
+    }
+    if (pid == 0) {
+        setsid();
+        int null = ::open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            if (null > STDERR_FILENO) close(null);
+        }
+        run(gitliteDir);
+        _exit(0);
+    }
+    for (int attempt = 0; attempt < 500 && !isRunning(gitliteDir); ++attempt) {
+        usleep(10000);
+    }
+#else
+    (void)gitliteDir;
+    Utils::exitWithMessage("File system monitor is not supported on this platform.");
+#endif
+}
+
+/** Asks a running daemon to exit.  Returns false if none was running. */
+bool FsMonitor::stop(const std::string& gitliteDir) {
+    std::string reply;
+    return request(gitliteDir, "stop\n", reply);
+}
+
+/** Runs the daemon in the foreground until it is stopped or the
+ *  repository goes away. */
+void FsMonitor::run(const std::string& gitliteDir) {
+#ifdef __linux__
+    signal(SIGPIPE, SIG_IGN);
+    Daemon daemon(gitliteDir);
+    if (daemon.open()) {
+        daemon.run();
+    }
+#else
+    (void)gitliteDir;
+#endif
+}
@@ -0,0 +1,553 @@
+#include "../include/Index.h"
+#include "../include/BinaryFormat.h"
+#include "../include/Utils.h"
+#include "../include/WorkTree.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char INDEX_MAGIC[4] = {'G', 'L', 'I', 'X'};
+static const uint32_t INDEX_VERSION = 4;
+static const size_t HEADER_SIZE = 20;
+static const char JOURNAL_MAGIC[4] = {'G', 'L', 'I', 'J'};
+static const uint32_t JOURNAL_VERSION = 1;
+static const size_t JOURNAL_HEADER_SIZE = 16;
+static const size_t MIN_COMPACT_SIZE = 64 * 1024;
+
+enum JournalOp : unsigned char {
+    STAGE = 1,
+    UNSTAGE = 2,
+    REMOVE = 3,
+    UNREMOVE = 4,
+    CACHE = 5,
+    UNCACHE = 6,
+};
+static const size_t ID_SIZE = BinaryFormat::RAW_ID_SIZE;
+static const size_t STAT_SIZE = 8 + 8 + 8 + 8 + 4;
+
+using BinaryFormat::get32;
+using BinaryFormat::get64;
+using BinaryFormat::put32;
+using BinaryFormat::put64;
+
+namespace {
+
+/** Bounds-checked cursor over the mapped index file. */
+class Reader {
+public:
+    Reader(const unsigned char* data, size_t size) : pos(data), end(data + size) {}
+
+    bool atEnd() const { return pos == end; }
+
+    const unsigned char* take(size_t n) {
+        if (static_cast<size_t>(end - pos) < n) {
+            throw std::invalid_argument("malformed index");
+        }
+        const unsigned char* start = pos;
+        pos += n;
+        return start;
+    }
+
+    uint32_t u32() { return get32(take(4)); }
+    uint64_t u64() { return get64(take(8)); }
+    ObjectId id() { return ObjectId::fromRaw(take(ID_SIZE)); }
+
+    std::string_view pathView() {
+        uint32_t length = u32();
+        return std::string_view(reinterpret_cast<const char*>(take(length)), length);
+    }
+
+    std::string path() { return std::string(pathView()); }
+
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+};
+
+void putPath(std::string& out, std::string_view path) {
+    put32(out, static_cast<uint32_t>(path.size()));
+    out += path;
+}
+
+void putId(std::string& out, const ObjectId& id) {
+    out.append(reinterpret_cast<const char*>(id.data()), ID_SIZE);
+}
+
+void putStat(std::string& out, const Index::Stat& stat) {
+    put64(out, stat.size);
+    put64(out, static_cast<uint64_t>(stat.mtimeNs));
+    put64(out, static_cast<uint64_t>(stat.ctimeNs));
+    put64(out, stat.inode);
+    put32(out, stat.mode);
+}
+
+Index::Stat readStat(Reader& in) {
+    Index::Stat stat;
+    stat.size = in.u64();
+    stat.mtimeNs = static_cast<int64_t>(in.u64());
+    stat.ctimeNs = static_cast<int64_t>(in.u64());
+    stat.inode = in.u64();
+    stat.mode = in.u32();
+    return stat;
+}
+
+/** A fresh, nonzero generation number for a new index. */
+uint64_t newGeneration() {
+    std::random_device random;
+    uint64_t value = 0;
+    while (value == 0) {
+        value = (static_cast<uint64_t>(random()) << 32) ^ random();
+    }
+    return value;
+}
+
+} // namespace
+
+Index::Index(const std::string& repositoryDir, std::pmr::memory_resource* resource)
+    : indexPath(repositoryDir + "/index"), journalPath(repositoryDir + "/index.journal"),
+      legacyPath(repositoryDir + "/STAGING"), cache(resource) {}
+
+/** Returns the cache entry for PATH, adding an empty one if needed. */
+Index::CacheEntry& Index::cacheEntry(std::string_view path) {
+    auto it = cache.lower_bound(path);
+    if (it == cache.end() || std::string_view(it->first) != path) {
+        it = cache.emplace_hint(it, path, CacheEntry());
+    }
+    return it->second;
+}
+
+/** Drops the cache entry for PATH.  Returns whether there was one. */
+bool Index::uncache(std::string_view path) {
+    auto it = cache.find(path);
+    if (it == cache.end()) {
+        return false;
+    }
+    cache.erase(it);
+    return true;
+}
+
+/** Reads the staging area into STAGED and REMOVED and the stat cache
+ *  into this object, replaying the journal on top of the index.
+ *  Repositories that still have the old text STAGING file are read from
+ *  that instead; the next save() replaces it. */
+void Index::load(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed) {
+    staged.clear();
+    removed.clear();
+    cache.clear();
+    token.clear();
+    listing.clear();
+    directories = WorkTree::DirectoryCache();
+    dirty = false;
+    generation = 0;
+    snapshotSize = journalSize = 0;
+    pending.clear();
+    needsSnapshot = false;
+
+    MappedFile file;
+    if (!file.open(indexPath)) {
+        loadLegacy(staged, removed);
+        replayJournal(staged, removed);
+        return;
+    }
+    snapshotSize = file.size();
+    Reader in(file.bytes(), file.size());
+    uint32_t version = 0;
+    if (std::memcmp(in.take(4), INDEX_MAGIC, 4) != 0 ||
+        (version = in.u32()) < 1 || version > INDEX_VERSION) {
+        throw std::invalid_argument("malformed index");
+    }
+    uint32_t stagedCount = in.u32();
+    uint32_t removedCount = in.u32();
+    uint32_t cachedCount = in.u32();
+
+    for (uint32_t i = 0; i < stagedCount; ++i) {
+        std::string path = in.path();
+        staged.emplace_hint(staged.end(), std::move(path), in.id());
+    }
+    for (uint32_t i = 0; i < removedCount; ++i) {
+        removed.emplace_hint(removed.end(), in.path());
+    }
+    for (uint32_t i = 0; i < cachedCount; ++i) {
+        std::string_view path = in.pathView();
+        CacheEntry entry;
+        entry.blob = in.id();
+        entry.stat.size = in.u64();
+        entry.stat.mtimeNs = static_cast<int64_t>(in.u64());
+        entry.stat.ctimeNs = static_cast<int64_t>(in.u64());
+        entry.stat.inode = in.u64();
+        entry.stat.mode = in.u32();
+        cache.emplace_hint(cache.end(), path, entry);
+    }
+    if (version >= 2) {
+        token = in.path();
+        uint32_t listedCount = in.u32();
+        for (uint32_t i = 0; i < listedCount; ++i) {
+            listing.emplace_hint(listing.end(), in.path());
+        }
+    }
+    if (version >= 3) {
+        uint32_t directoryCount = in.u32();
+        for (uint32_t i = 0; i < directoryCount; ++i) {
+            std::string path = in.path();
+            WorkTree::Listing entry;
+            entry.mtimeNs = static_cast<int64_t>(in.u64());
+            entry.ctimeNs = static_cast<int64_t>(in.u64());
+            entry.inode = in.u64();
+            entry.nestedRepository = in.u32() != 0;
+            entry.files.resize(in.u32());
+            for (auto& name : entry.files) name = in.path();
+            entry.directories.resize(in.u32());
+            for (auto& name : entry.directories) name = in.path();
+            directories.listings.emplace_hint(directories.listings.end(), std::move(path),
+                                              std::move(entry));
+        }
+    }
+    if (version >= 4) {
+        generation = in.u64();
+    }
+    if (!in.atEnd()) {
+        throw std::invalid_argument("malformed index");
+    }
+    replayJournal(staged, removed);
+}
+
+/** Applies the records of a journal written for this generation of the
+ *  index.  A journal for another generation, or one whose last record
+ *  was cut short, makes the next append() write a new index. */
+void Index::replayJournal(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed) {
+    MappedFile file;
+    if (!file.open(journalPath)) return;
+    const unsigned char* base = file.bytes();
+    if (file.size() < JOURNAL_HEADER_SIZE || std::memcmp(base, JOURNAL_MAGIC, 4) != 0 ||
+        get32(base + 4) != JOURNAL_VERSION || get64(base + 8) != generation || generation == 0) {
+        needsSnapshot = true;
+        return;
+    }
+    journalSize = file.size();
+
+    Reader in(base + JOURNAL_HEADER_SIZE, file.size() - JOURNAL_HEADER_SIZE);
+    try {
+        while (!in.atEnd()) {
+            unsigned char op = *in.take(1);
+            std::string path = in.path();
+            switch (op) {
+            case STAGE: staged[path] = in.id(); break;
+            case UNSTAGE: staged.erase(path); break;
+            case REMOVE: removed.insert(path); break;
+            case UNREMOVE: removed.erase(path); break;
+            case CACHE: {
+                CacheEntry entry;
+                entry.blob = in.id();
+                entry.stat = readStat(in);
+                cacheEntry(path) = entry;
+                break;
+            }
+            case UNCACHE: uncache(path); break;
+            default: throw std::invalid_argument("malformed index journal");
+            }
+        }
+    } catch (const std::invalid_argument&) {
+        needsSnapshot = true;
+    }
+}
+
+/** Reads the text STAGING file written by older versions. */
+void Index::loadLegacy(std::map<std::string, ObjectId>& staged, std::set<std::string>& removed) {
+    if (!Utils::exists(legacyPath)) return;
+    std::stringstream ss(Utils::readContentsAsString(legacyPath));
+
+    size_t stagedCount = 0, removedCount = 0;
+    ss >> stagedCount;
+    for (size_t i = 0; i < stagedCount; ++i) {
+        std::string filename, hash;
+        ss >> filename >> hash;
+        staged[filename] = ObjectId::fromHex(hash);
+    }
+    ss >> removedCount;
+    for (size_t i = 0; i < removedCount; ++i) {
+        std::string filename;
+        ss >> filename;
+        removed.insert(filename);
+    }
+}
+
+/** Writes STAGED, REMOVED, the stat cache and the monitor state to the
+ *  index file. */
+void Index::save(const std::map<std::string, ObjectId>& staged, const std::set<std::string>& removed) {
+    std::string out;
+    out.reserve(HEADER_SIZE + cache.size() * (64 + ID_SIZE + STAT_SIZE));
+    out.append(INDEX_MAGIC, 4);
+    put32(out, INDEX_VERSION);
+    put32(out, static_cast<uint32_t>(staged.size()));
+    put32(out, static_cast<uint32_t>(removed.size()));
+    put32(out, static_cast<uint32_t>(cache.size()));
+
+    for (const auto& [path, blob] : staged) {
+        putPath(out, path);
+        putId(out, blob);
+    }
+    for (const auto& path : removed) {
+        putPath(out, path);
+    }
+    for (const auto& [path, entry] : cache) {
+        putPath(out, path);
+        putId(out, entry.blob);
+        putStat(out, entry.stat);
+    }
+    putPath(out, token);
+    if (token.empty()) {
+        put32(out, 0);
+    } else {
+        put32(out, static_cast<uint32_t>(listing.size()));
+        for (const auto& path : listing) {
+            putPath(out, path);
+        }
+    }
+    put32(out, static_cast<uint32_t>(directories.listings.size()));
+    for (const auto& [path, entry] : directories.listings) {
+        putPath(out, path);
+        put64(out, static_cast<uint64_t>(entry.mtimeNs));
+        put64(out, static_cast<uint64_t>(entry.ctimeNs));
+        put64(out, entry.inode);
+        put32(out, entry.nestedRepository ? 1 : 0);
+        put32(out, static_cast<uint32_t>(entry.files.size()));
+        for (const auto& name : entry.files) putPath(out, name);
+        put32(out, static_cast<uint32_t>(entry.directories.size()));
+        for (const auto& name : entry.directories) putPath(out, name);
+    }
+    generation = newGeneration();
+    put64(out, generation);
+
+    Utils::writeContents(indexPath, out);
+    unlink(journalPath.c_str());
+    if (Utils::exists(legacyPath)) {
+        unlink(legacyPath.c_str());
+    }
+    snapshotSize = out.size();
+    journalSize = 0;
+    pending.clear();
+    needsSnapshot = false;
+    dirty = false;
+    directories.changed = false;
+}
+
+/** Persists the changes recorded since load() by appending them to the
+ *  journal, or with save() when some of them cannot be journaled or the
+ *  journal has grown past half the index. */
+void Index::append(const std::map<std::string, ObjectId>& staged, const std::set<std::string>& removed) {
+    size_t grown = journalSize + pending.size();
+    if (needsSnapshot || directories.changed || generation == 0 ||
+        (grown > MIN_COMPACT_SIZE && grown > snapshotSize / 2)) {
+        save(staged, removed);
+        return;
+    }
+    if (pending.empty()) return;
+
+    int fd = ::open(journalPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        throw std::invalid_argument("cannot write index journal");
+    }
+    std::string out;
+    if (st.st_size == 0) {
+        out.append(JOURNAL_MAGIC, 4);
+        put32(out, JOURNAL_VERSION);
+        put64(out, generation);
+    }
+    out += pending;
+    const char* data = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = write(fd, data, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            throw std::invalid_argument("cannot write index journal");
+        }
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    close(fd);
+    journalSize = static_cast<size_t>(st.st_size) + out.size();
+    pending.clear();
+    dirty = false;
+}
+
+/** Encodes one journal record into the pending batch. */
+void Index::journal(unsigned char op, const std::string& path, const ObjectId* blob,
+                    const Stat* stat) {
+    pending.push_back(static_cast<char>(op));
+    putPath(pending, path);
+    if (blob != nullptr) putId(pending, *blob);
+    if (stat != nullptr) putStat(pending, *stat);
+}
+
+void Index::journalStage(const std::string& path, const ObjectId& blob) {
+    journal(STAGE, path, &blob);
+}
+
+void Index::journalUnstage(const std::string& path) {
+    journal(UNSTAGE, path);
+}
+
+void Index::journalRemove(const std::string& path) {
+    journal(REMOVE, path);
+}
+
+void Index::journalUnremove(const std::string& path) {
+    journal(UNREMOVE, path);
+}
+
+/** Fills STAT for the file PATH.  Returns false if it cannot be stat'ed. */
+bool Index::statFile(const char* path, Stat& stat) {
+    struct stat st;
+    if (::stat(path, &st) != 0) {
+        return false;
+    }
+    stat.size = static_cast<uint64_t>(st.st_size);
+    stat.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stat.ctimeNs = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+    stat.inode = static_cast<uint64_t>(st.st_ino);
+    stat.mode = static_cast<uint32_t>(st.st_mode);
+    return true;
+}
+
+/** Sets BLOB to the cached id of PATH if its stat data is unchanged. */
+bool Index::cached(const std::string& path, const Stat& stat, ObjectId& blob) const {
+    auto it = cache.find(std::string_view(path));
+    if (it == cache.end() || !(it->second.stat == stat)) {
+        return false;
+    }
+    blob = it->second.blob;
+    return true;
+}
+
+/** Caches BLOB for PATH unless its timestamps are racy with respect to
+ *  STARTNS, the clock reading taken before PATH was stat'ed. */
+void Index::remember(const std::string& path, const Stat& stat, const ObjectId& blob,
+                     int64_t startNs) {
+    if (stat.mtimeNs >= startNs || stat.ctimeNs >= startNs) {
+        if (uncache(path)) {
+            journal(UNCACHE, path);
+            dirty = true;
+        }
+        return;
+    }
+    CacheEntry& entry = cacheEntry(path);
+    if (entry.blob != blob || !(entry.stat == stat)) {
+        entry.blob = blob;
+        entry.stat = stat;
+        journal(CACHE, path, &blob, &stat);
+        dirty = true;
+    }
+}
+
+/** Returns the blob id of working file PATH, reading it only if its stat
+ *  data differs from the cached entry.  If UNCHANGED, the file system
+ *  monitor vouches that PATH was not touched since the cache was last
+ *  checked, and a cached id is returned without even a stat. */
+ObjectId Index::hashFile(const std::string& path, bool unchanged) {
+    if (unchanged) {
+        auto it = cache.find(std::string_view(path));
+        if (it != cache.end()) return it->second.blob;
+    }
+    int64_t start = WorkTree::timestampClock();
+    Stat stat;
+    ObjectId blob;
+    bool statted = statFile(path.c_str(), stat);
+    if (statted && cached(path, stat, blob)) {
+        return blob;
+    }
+    blob = Utils::sha1File(path);
+    if (statted) {
+        remember(path, stat, blob, start);
+    }
+    return blob;
+}
+
+/** hashFile() for every path in PATHS, stat'ing and hashing on POOL.
+ *  CHANGED, if given, holds the paths the file system monitor reported;
+ *  all others are taken as unchanged. */
+std::vector<ObjectId> Index::hashFiles(const std::vector<std::string>& paths, ThreadPool& pool,
+                                       const std::set<std::string>* changed) {
+    int64_t start = WorkTree::timestampClock();
+    std::vector<ObjectId> blobs(paths.size());
+    std::vector<Stat> stats(paths.size());
+    std::vector<char> hashed(paths.size(), 0);
+    pool.parallelFor(paths.size(), [&](size_t i) {
+        if (changed != nullptr && changed->count(paths[i]) == 0) {
+            auto it = cache.find(std::string_view(paths[i]));
+            if (it != cache.end()) {
+                blobs[i] = it->second.blob;
+                return;
+            }
+        }
+        bool statted = statFile(paths[i].c_str(), stats[i]);
+        if (statted && cached(paths[i], stats[i], blobs[i])) {
+            return;
+        }
+        blobs[i] = Utils::sha1File(paths[i]);
+        hashed[i] = statted ? 1 : 0;
+    });
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (hashed[i]) {
+            remember(paths[i], stats[i], blobs[i], start);
+        }
+    }
+    return blobs;
+}
+
+/** Drops cache entries for files not in PATHS.  Both are sorted, so
+ *  this is one merge pass. */
+void Index::retain(const std::set<std::string>& paths) {
+    auto path = paths.begin();
+    for (auto it = cache.begin(); it != cache.end();) {
+        std::string_view cachedPath(it->first);
+        while (path != paths.end() && std::string_view(*path) < cachedPath) ++path;
+        if (path == paths.end() || std::string_view(*path) != cachedPath) {
+            it = cache.erase(it);
+            dirty = needsSnapshot = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** Drops the cache entries for PATH and everything below it. */
+void Index::invalidate(const std::string& path) {
+    if (uncache(path)) dirty = needsSnapshot = true;
+    std::string prefix = path + "/";
+    auto it = cache.lower_bound(std::string_view(prefix));
+    while (it != cache.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        it = cache.erase(it);
+        dirty = needsSnapshot = true;
+    }
+}
+
+/** Drops every cache entry whose file no longer has the cached stat
+ *  data, so that all remaining entries are known good as of now. */
+void Index::revalidate() {
+    for (auto it = cache.begin(); it != cache.end();) {
+        Stat stat;
+        if (!statFile(it->first.c_str(), stat) || !(stat == it->second.stat)) {
+            it = cache.erase(it);
+            dirty = needsSnapshot = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** Sets the monitor token that workingFiles() is valid for; empty when
+ *  no monitor is running, in which case the list is not saved. */
+void Index::setMonitorToken(const std::string& newToken) {
+    if (newToken == token) return;
+    token = newToken;
+    dirty = needsSnapshot = true;
+}
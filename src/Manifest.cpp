@@ -0,0 +1,81 @@
+#include "../include/Manifest.h"
+#include "../include/Commit.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+static const size_t BLOCK_SIZE = 64 * 1024;
+static const size_t INITIAL_SLOTS = 1024;
+
+PathTable::PathTable(std::pmr::memory_resource* resource)
+    : memory(resource), blocks(resource), blockUsed(0), paths(resource),
+      slots(INITIAL_SLOTS, EMPTY, resource) {}
+
+PathTable::~PathTable() {
+    for (const Block& block : blocks) {
+        memory->deallocate(block.data, block.capacity, 1);
+    }
+}
+
+/** Returns the id of PATH, adding it on first use. */
+PathId PathTable::intern(std::string_view path) {
+    size_t mask = slots.size() - 1;
+    size_t slot = std::hash<std::string_view>()(path) & mask;
+    while (slots[slot] != EMPTY) {
+        if (paths[slots[slot]] == path) {
+            return slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    PathId id = static_cast<PathId>(paths.size());
+    paths.push_back(store(path));
+    slots[slot] = id;
+    if (paths.size() * 2 > slots.size()) {
+        grow();
+    }
+    return id;
+}
+
+/** Copies PATH into the current block.  A path longer than a block gets a block
+ *  of its own. */
+std::string_view PathTable::store(std::string_view path) {
+    if (blocks.empty() || blockUsed + path.size() > blocks.back().capacity) {
+        size_t capacity = std::max(BLOCK_SIZE, path.size());
+        blocks.push_back({static_cast<char*>(memory->allocate(capacity, 1)), capacity});
+        blockUsed = 0;
+    }
+    char* start = blocks.back().data + blockUsed;
+    std::memcpy(start, path.data(), path.size());
+    blockUsed += path.size();
+    return std::string_view(start, path.size());
+}
+
+/** Doubles the lookup table and reinserts every id. */
+void PathTable::grow() {
+    std::pmr::vector<PathId> larger(slots.size() * 2, EMPTY, memory);
+    size_t mask = larger.size() - 1;
+    for (PathId id = 0; id < paths.size(); ++id) {
+        size_t slot = std::hash<std::string_view>()(paths[id]) & mask;
+        while (larger[slot] != EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        larger[slot] = id;
+    }
+    slots.swap(larger);
+}
+
+/** Returns the manifest of COMMIT, or an empty one for a null commit,
+ *  allocated from the resource of PATHS.  Commit::files() is already
+ *  sorted by path, so no sort is needed. */
+Manifest Manifest::of(const Commit* commit, PathTable& paths) {
+    Manifest manifest(paths.resource());
+    if (commit == nullptr) {
+        return manifest;
+    }
+    const Commit::FileList& files = commit->files();
+    manifest.entries.reserve(files.size());
+    for (const auto& file : files) {
+        manifest.entries.push_back({paths.intern(file.filename), file.blob});
+    }
+    return manifest;
+}
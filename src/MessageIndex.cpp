@@ -0,0 +1,355 @@
+#include "../include/MessageIndex.h"
+#include "../include/BinaryFormat.h"
+#include "../include/Commit.h"
+#include "../include/CommitGraph.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char INDEX_MAGIC[4] = {'G', 'L', 'M', 'I'};
+static const uint32_t INDEX_VERSION = 1;
+static const size_t HEADER_SIZE = 24;
+static const size_t ID_SIZE = BinaryFormat::RAW_ID_SIZE;
+static const size_t MESSAGE_SIZE = 8;
+static const size_t TRIGRAM_SIZE = 12;
+static const uint32_t NONE = 0xffffffff;
+static const size_t MIN_COMPACT_SIZE = 64 * 1024;
+
+using BinaryFormat::get32;
+using BinaryFormat::put32;
+
+namespace {
+
+/** FNV-1a; stored hash tables need a hash that never changes. */
+uint64_t hashMessage(std::string_view message) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : message) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** The distinct trigrams of TEXT, ascending. */
+std::vector<uint32_t> trigramsOf(std::string_view text) {
+    std::vector<uint32_t> keys;
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        keys.push_back((static_cast<uint32_t>(static_cast<unsigned char>(text[i])) << 16) |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(text[i + 1])) << 8) |
+                       static_cast<uint32_t>(static_cast<unsigned char>(text[i + 2])));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+/** Binary search of the ascending u32 list at LIST. */
+bool listContains(const unsigned char* list, uint32_t length, uint32_t value) {
+    uint32_t lo = 0, hi = length;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t at = get32(list + 4 * static_cast<size_t>(mid));
+        if (at == value) return true;
+        if (at < value) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+std::vector<ObjectId> sortedUnique(std::vector<ObjectId> ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+} // namespace
+
+MessageIndex::MessageIndex(const ObjectStore& objects)
+    : objects(objects), indexPath(objects.directory() + "/info/message-index"),
+      logPath(objects.directory() + "/info/message-index.log") {}
+
+/** Maps the index file.  Returns false if it is missing or malformed. */
+bool MessageIndex::load() {
+    file.close();
+    loaded = false;
+    count = slotCount = trigramCount = 0;
+    if (!file.open(indexPath) || file.size() < HEADER_SIZE) {
+        file.close();
+        return false;
+    }
+    const unsigned char* base = file.bytes();
+    uint32_t n = get32(base + 8);
+    uint32_t s = get32(base + 12);
+    uint32_t t = get32(base + 16);
+    uint32_t p = get32(base + 20);
+    size_t fixed = HEADER_SIZE + static_cast<size_t>(n) * (ID_SIZE + MESSAGE_SIZE) +
+                   static_cast<size_t>(s) * 4 + static_cast<size_t>(t) * TRIGRAM_SIZE +
+                   static_cast<size_t>(p) * 4;
+    if (std::memcmp(base, INDEX_MAGIC, 4) != 0 || get32(base + 4) != INDEX_VERSION ||
+        file.size() < fixed || (s & (s - 1)) != 0 || (n > 0 && s == 0)) {
+        file.close();
+        return false;
+    }
+    count = n;
+    slotCount = s;
+    trigramCount = t;
+    ids = base + HEADER_SIZE;
+    messages = ids + static_cast<size_t>(n) * ID_SIZE;
+    slots = messages + static_cast<size_t>(n) * MESSAGE_SIZE;
+    trigrams = slots + static_cast<size_t>(s) * 4;
+    postings = trigrams + static_cast<size_t>(t) * TRIGRAM_SIZE;
+    text = reinterpret_cast<const char*>(postings + static_cast<size_t>(p) * 4);
+    textSize = file.size() - fixed;
+    loaded = true;
+    return true;
+}
+
+/** Loads the index, building it from every commit in GRAPH the first
+ *  time a repository without one is searched. */
+void MessageIndex::ensureLoaded(const CommitGraph& graph) {
+    if (loaded || load()) return;
+    std::vector<Entry> entries;
+    entries.reserve(graph.size());
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        ObjectId id = graph.objectId(i);
+        std::shared_ptr<const Commit> commit = Commit::parse(id.hex(), objects.read(id));
+        if (commit) {
+            entries.push_back({id, std::string(commit->message())});
+        }
+    }
+    rebuild(std::move(entries));
+}
+
+/** Replaces the index with one holding exactly ENTRIES and drops the
+ *  log. */
+void MessageIndex::rebuild(std::vector<Entry> entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.id < b.id; });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const Entry& a, const Entry& b) { return a.id == b.id; }),
+                  entries.end());
+    uint32_t n = static_cast<uint32_t>(entries.size());
+
+    uint32_t s = 16;
+    while (s < 2 * static_cast<size_t>(n)) s *= 2;
+    std::vector<uint32_t> table(s, NONE);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;  // (trigram, position)
+    size_t textBytes = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const std::string& message = entries[i].message;
+        size_t slot = hashMessage(message) & (s - 1);
+        while (table[slot] != NONE) slot = (slot + 1) & (s - 1);
+        table[slot] = i;
+        for (uint32_t key : trigramsOf(message)) {
+            pairs.emplace_back(key, i);
+        }
+        textBytes += message.size();
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    std::string out;
+    out.reserve(HEADER_SIZE + static_cast<size_t>(n) * (ID_SIZE + MESSAGE_SIZE) + 4 * s +
+                pairs.size() * 4 + textBytes);
+    std::vector<std::pair<uint32_t, uint32_t>> keys;  // (trigram, first posting)
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+            keys.emplace_back(pairs[i].first, static_cast<uint32_t>(i));
+        }
+    }
+
+    out.append(INDEX_MAGIC, 4);
+    put32(out, INDEX_VERSION);
+    put32(out, n);
+    put32(out, s);
+    put32(out, static_cast<uint32_t>(keys.size()));
+    put32(out, static_cast<uint32_t>(pairs.size()));
+    for (const auto& entry : entries) {
+        out.append(reinterpret_cast<const char*>(entry.id.data()), ID_SIZE);
+    }
+    uint32_t offset = 0;
+    for (const auto& entry : entries) {
+        put32(out, offset);
+        put32(out, static_cast<uint32_t>(entry.message.size()));
+        offset += static_cast<uint32_t>(entry.message.size());
+    }
+    for (uint32_t position : table) {
+        put32(out, position);
+    }
+    for (size_t k = 0; k < keys.size(); ++k) {
+        size_t end = k + 1 < keys.size() ? keys[k + 1].second : pairs.size();
+        put32(out, keys[k].first);
+        put32(out, keys[k].second);
+        put32(out, static_cast<uint32_t>(end - keys[k].second));
+    }
+    for (const auto& pair : pairs) {
+        put32(out, pair.second);
+    }
+    for (const auto& entry : entries) {
+        out += entry.message;
+    }
+
+    file.close();
+    Utils::writeContents(indexPath, out);
+    unlink(logPath.c_str());
+    load();
+}
+
+/** Records newly created commits: appends them to the log, and merges
+ *  the log into a new index once it has grown past a quarter of it. */
+void MessageIndex::add(const std::vector<Entry>& entries) {
+    if (entries.empty()) return;
+    std::string out;
+    for (const auto& entry : entries) {
+        out.append(reinterpret_cast<const char*>(entry.id.data()), ID_SIZE);
+        put32(out, static_cast<uint32_t>(entry.message.size()));
+        out += entry.message;
+    }
+    Utils::createDirectories(objects.directory() + "/info");
+    int fd = ::open(logPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        throw std::invalid_argument("cannot write message index log");
+    }
+    const char* data = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = write(fd, data, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    struct stat st;
+    bool grown = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > MIN_COMPACT_SIZE;
+    close(fd);
+    if (left > 0) {
+        throw std::invalid_argument("cannot write message index log");
+    }
+
+    // Without an index the log cannot be merged; the next search rebuilds
+    // the index from the commit graph instead.
+    if (grown && (loaded || load()) && static_cast<size_t>(st.st_size) > file.size() / 4) {
+        std::vector<Entry> all = decodeAll();
+        std::vector<Entry> logged = readLog();
+        all.insert(all.end(), std::make_move_iterator(logged.begin()),
+                   std::make_move_iterator(logged.end()));
+        rebuild(std::move(all));
+    }
+}
+
+/** Returns the ids of the commits whose message is exactly MESSAGE, in
+ *  ascending order. */
+std::vector<ObjectId> MessageIndex::exact(std::string_view message) const {
+    std::vector<ObjectId> result;
+    if (count > 0) {
+        size_t slot = hashMessage(message) & (slotCount - 1);
+        for (uint32_t position; (position = get32(slots + 4 * slot)) != NONE;
+             slot = (slot + 1) & (slotCount - 1)) {
+            if (position < count && messageAt(position) == message) {
+                result.push_back(idAt(position));
+            }
+        }
+    }
+    for (const auto& entry : readLog()) {
+        if (entry.message == message) result.push_back(entry.id);
+    }
+    return sortedUnique(std::move(result));
+}
+
+/** Returns the ids of the commits whose message contains TEXT, in
+ *  ascending order. */
+std::vector<ObjectId> MessageIndex::substring(std::string_view text) const {
+    std::vector<ObjectId> result;
+    if (text.size() < 3) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (messageAt(i).find(text) != std::string_view::npos) result.push_back(idAt(i));
+        }
+    } else if (count > 0) {
+        std::vector<std::pair<const unsigned char*, uint32_t>> lists;
+        bool missing = false;
+        for (uint32_t key : trigramsOf(text)) {
+            const unsigned char* first;
+            uint32_t length;
+            if (!postingsOf(key, first, length)) {
+                missing = true;
+                break;
+            }
+            lists.emplace_back(first, length);
+        }
+        if (!missing) {
+            std::sort(lists.begin(), lists.end(),
+                      [](const auto& a, const auto& b) { return a.second < b.second; });
+            for (uint32_t i = 0; i < lists[0].second; ++i) {
+                uint32_t position = get32(lists[0].first + 4 * static_cast<size_t>(i));
+                bool everywhere = true;
+                for (size_t k = 1; k < lists.size() && everywhere; ++k) {
+                    everywhere = listContains(lists[k].first, lists[k].second, position);
+                }
+                if (everywhere && position < count &&
+                    messageAt(position).find(text) != std::string_view::npos) {
+                    result.push_back(idAt(position));
+                }
+            }
+        }
+    }
+    for (const auto& entry : readLog()) {
+        if (entry.message.find(text) != std::string::npos) result.push_back(entry.id);
+    }
+    return sortedUnique(std::move(result));
+}
+
+ObjectId MessageIndex::idAt(uint32_t position) const {
+    return ObjectId::fromRaw(ids + static_cast<size_t>(position) * ID_SIZE);
+}
+
+std::string_view MessageIndex::messageAt(uint32_t position) const {
+    const unsigned char* record = messages + static_cast<size_t>(position) * MESSAGE_SIZE;
+    size_t offset = get32(record);
+    size_t length = get32(record + 4);
+    if (offset > textSize || length > textSize - offset) return std::string_view();
+    return std::string_view(text + offset, length);
+}
+
+/** Finds the postings of trigram KEY by binary search. */
+bool MessageIndex::postingsOf(uint32_t key, const unsigned char*& first, uint32_t& length) const {
+    uint32_t lo = 0, hi = trigramCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const unsigned char* record = trigrams + static_cast<size_t>(mid) * TRIGRAM_SIZE;
+        uint32_t at = get32(record);
+        if (at == key) {
+            first = postings + 4 * static_cast<size_t>(get32(record + 4));
+            length = get32(record + 8);
+            return true;
+        }
+        if (at < key) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+/** Returns the log's complete records; a torn last record is ignored. */
+std::vector<MessageIndex::Entry> MessageIndex::readLog() const {
+    std::vector<Entry> entries;
+    MappedFile log;
+    if (!log.open(logPath)) return entries;
+    const unsigned char* pos = log.bytes();
+    const unsigned char* end = pos + log.size();
+    while (static_cast<size_t>(end - pos) >= ID_SIZE + 4) {
+        uint32_t length = get32(pos + ID_SIZE);
+        if (static_cast<size_t>(end - pos) - ID_SIZE - 4 < length) break;
+        entries.push_back({ObjectId::fromRaw(pos),
+                           std::string(reinterpret_cast<const char*>(pos + ID_SIZE + 4), length)});
+        pos += ID_SIZE + 4 + length;
+    }
+    return entries;
+}
+
+std::vector<MessageIndex::Entry> MessageIndex::decodeAll() const {
+    std::vector<Entry> entries(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i].id = idAt(i);
+        entries[i].message = std::string(messageAt(i));
+    }
+    return entries;
+}
@@ -0,0 +1,223 @@
+#include "../include/ObjectStore.h"
+#include "../include/PackFile.h"
+#include "../include/Transaction.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+// Marks a store whose objects are already in the fan-out layout.
+static const char* LAYOUT_MARKER = "info/layout";
+static const char* LAYOUT_FANOUT = "fanout\n";
+
+ObjectStore::ObjectStore(const std::string& objectsDir) : objectsDir(objectsDir) {
+    loadPacks();
+}
+
+/** Returns true if NAME looks like a full 40-char hex object id. */
+bool ObjectStore::isObjectId(std::string_view name) {
+    if (name.length() != static_cast<size_t>(Utils::UID_LENGTH)) return false;
+    return name.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+}
+
+/** Returns the file that holds (or would hold) object ID. */
+std::string ObjectStore::path(const ObjectId& id) const {
+    char hex[ObjectId::HEX_SIZE];
+    id.toHex(hex);
+    std::string result;
+    result.reserve(objectsDir.size() + ObjectId::HEX_SIZE + 2);
+    result.append(objectsDir).append("/").append(hex, 2).append("/").append(hex + 2, ObjectId::HEX_SIZE - 2);
+    return result;
+}
+
+bool ObjectStore::contains(const ObjectId& id) const {
+    for (const auto& pack : packs) {
+        if (pack->contains(id)) return true;
+    }
+    return Utils::isFile(path(id));
+}
+
+std::string ObjectStore::read(const ObjectId& id) const {
+    std::string content;
+    for (const auto& pack : packs) {
+        if (pack->read(id, content)) return content;
+    }
+    return Utils::readContentsAsString(path(id));
+}
+
+std::string ObjectStore::path(const std::string& id) const {
+    if (id.length() < 3) {
+        return objectsDir + "/" + id;
+    }
+    return objectsDir + "/" + id.substr(0, 2) + "/" + id.substr(2);
+}
+
+bool ObjectStore::contains(const std::string& id) const {
+    ObjectId objectId;
+    return ObjectId::fromHex(id, objectId) && contains(objectId);
+}
+
+std::string ObjectStore::read(const std::string& id) const {
+    ObjectId objectId;
+    if (!ObjectId::fromHex(id, objectId)) {
+        throw std::invalid_argument("not an object id: " + id);
+    }
+    return read(objectId);
+}
+
+/** Writes the contents of object ID to the file TARGET.  Loose objects
+ *  and whole packed objects are written straight from their mapping;
+ *  only deltas are rebuilt in memory. */
+void ObjectStore::copyTo(const ObjectId& id, const std::string& target) const {
+    for (const auto& pack : packs) {
+        std::string_view view;
+        if (pack->view(id, view)) {
+            Utils::writeContents(target, view);
+            return;
+        }
+        std::string content;
+        if (pack->read(id, content)) {
+            Utils::writeContents(target, content);
+            return;
+        }
+    }
+    Utils::copyContents(path(id), target);
+}
+
+void ObjectStore::write(const ObjectId& id, const std::string& content) const {
+    Utils::writeContents(path(id), content);
+}
+
+void ObjectStore::write(const std::string& id, const std::string& content) const {
+    Utils::writeContents(path(id), content);
+}
+
+/** Stores the contents of the working file SOURCE as object ID without
+ *  loading it into memory. */
+void ObjectStore::writeFromFile(const ObjectId& id, const std::string& source) const {
+    Utils::copyContents(source, path(id));
+}
+
+/** Returns the ids of all objects in the store, packed or loose, in
+ *  ascending order. */
+std::vector<ObjectId> ObjectStore::allIds() const {
+    std::vector<ObjectId> ids = looseIds();
+    for (const auto& pack : packs) {
+        std::vector<ObjectId> packed = pack->allIds();
+        ids.insert(ids.end(), packed.begin(), packed.end());
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+/** Returns the ids of the loose objects.  Only the 256 fan-out
+ *  directories are listed, never the store root's own entries. */
+std::vector<ObjectId> ObjectStore::looseIds() const {
+    static const char HEX[] = "0123456789abcdef";
+    std::vector<ObjectId> ids;
+    for (int hi = 0; hi < 16; ++hi) {
+        for (int lo = 0; lo < 16; ++lo) {
+            std::string prefix = {HEX[hi], HEX[lo]};
+            for (const auto& rest : Utils::plainFilenamesIn(objectsDir + "/" + prefix)) {
+                ObjectId id;
+                if (ObjectId::fromHex(prefix + rest, id)) {
+                    ids.push_back(id);
+                }
+            }
+        }
+    }
+    return ids;
+}
+
+std::string ObjectStore::packDirectory() const {
+    return objectsDir + "/pack";
+}
+
+/** Maps every complete pack (one whose .idx exists) in objects/pack/. */
+void ObjectStore::loadPacks() {
+    packs.clear();
+    for (const auto& name : Utils::plainFilenamesIn(packDirectory())) {
+        std::shared_ptr<const PackFile> pack = PackFile::open(packDirectory() + "/" + name);
+        if (pack) {
+            packs.push_back(pack);
+        }
+    }
+}
+
+/** Moves every object into a single new pack.  Objects listed in
+ *  PREFERREDORDER are stored first, in that order, so that walks which
+ *  visit them in that order read the pack sequentially; the rest follow
+ *  in id order.  DELTABASES suggests, for an object, a similar object
+ *  to delta-encode it against (see PackFile::write).  The loose copies
+ *  and the packs they were merged from are deleted once the new pack is
+ *  in place. */
+void ObjectStore::repack(const std::vector<ObjectId>& preferredOrder,
+                         const std::map<ObjectId, ObjectId>& deltaBases) {
+    std::vector<ObjectId> loose = looseIds();
+    std::vector<ObjectId> all = allIds();
+    if (all.empty() || (loose.empty() && packs.size() <= 1)) {
+        return;
+    }
+
+    std::vector<ObjectId> order;
+    order.reserve(all.size());
+    for (const auto& id : preferredOrder) {
+        if (std::binary_search(all.begin(), all.end(), id)) {
+            order.push_back(id);
+        }
+    }
+    order.insert(order.end(), all.begin(), all.end());
+
+    std::string indexPath = PackFile::write(packDirectory(), order,
+                                            [this](const ObjectId& id) { return read(id); },
+                                            deltaBases);
+
+    // The new pack must be on disk before anything it replaces is deleted.
+    Transaction transaction(objectsDir);
+    transaction.add(indexPath);
+    transaction.add(indexPath.substr(0, indexPath.size() - 4) + ".pack");
+    transaction.commit();
+
+    for (const auto& pack : packs) {
+        if (pack->indexPath() != indexPath) {
+            std::remove(pack->indexPath().c_str());
+            std::remove(pack->packPath().c_str());
+        }
+    }
+    for (const auto& id : loose) {
+        std::remove(path(id).c_str());
+    }
+    // Drop fan-out directories that are now empty (remove() fails on the rest).
+    for (const auto& id : loose) {
+        std::string file = path(id);
+        std::remove(file.substr(0, file.find_last_of('/')).c_str());
+    }
+    loadPacks();
+}
+
+std::string ObjectStore::layoutMarkerPath() const {
+    return objectsDir + "/" + LAYOUT_MARKER;
+}
+
+/** Records that a freshly created store uses the fan-out layout. */
+void ObjectStore::initLayout() const {
+    Utils::writeContents(layoutMarkerPath(), LAYOUT_FANOUT);
+}
+
+/** One-shot upgrade of a store created with the old flat layout
+ *  (objects/<40-hex>): every loose object is renamed into its fan-out
+ *  directory and the layout marker is written.  A no-op once the marker
+ *  exists, so it costs a single stat on every later run. */
+void ObjectStore::migrateLayout() const {
+    if (!Utils::isDirectory(objectsDir) || Utils::isFile(layoutMarkerPath())) {
+        return;
+    }
+    for (const auto& name : Utils::plainFilenamesIn(objectsDir)) {
+        if (!isObjectId(name)) continue;
+        std::string target = path(name);
+        Utils::createDirectories(objectsDir + "/" + name.substr(0, 2));
+        std::rename((objectsDir + "/" + name).c_str(), target.c_str());
+    }
+    initLayout();
+}
@@ -0,0 +1,68 @@
+#include "../include/Output.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <unistd.h>
+
+Output::Output(int fd) : fd(fd), buffer(new char[CAPACITY]) {}
+
+Output::~Output() {
+    flush();
+}
+
+/** The buffer for standard output, flushed at the latest when the
+ *  process exits. */
+Output& Output::standard() {
+    static Output output(STDOUT_FILENO);
+    return output;
+}
+
+Output& Output::operator<<(std::string_view text) {
+    if (used + text.size() > CAPACITY) {
+        flush();
+        if (text.size() > CAPACITY) {
+            writeAll(text.data(), text.size());
+            return *this;
+        }
+    }
+    std::memcpy(buffer.get() + used, text.data(), text.size());
+    used += text.size();
+    return *this;
+}
+
+Output& Output::operator<<(char c) {
+    if (used == CAPACITY) flush();
+    buffer[used++] = c;
+    return *this;
+}
+
+Output& Output::operator<<(const ObjectId& id) {
+    if (used + ObjectId::HEX_SIZE > CAPACITY) flush();
+    id.toHex(buffer.get() + used);
+    used += ObjectId::HEX_SIZE;
+    return *this;
+}
+
+Output& Output::operator<<(int64_t value) {
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    return *this << std::string_view(digits, static_cast<size_t>(end - digits));
+}
+
+void Output::flush() {
+    size_t length = used;
+    used = 0;
+    writeAll(buffer.get(), length);
+}
+
+/** Writes all of DATA, retrying short and interrupted writes.  Output
+ *  the reader no longer wants (a closed pipe) is dropped. */
+void Output::writeAll(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+}
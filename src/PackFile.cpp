@@ -0,0 +1,338 @@
+#include "../include/PackFile.h"
+#include "../include/Utils.h"
+#include "../include/BinaryFormat.h"
+#include "../include/Delta.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char PACK_MAGIC[4] = {'G', 'L', 'P', 'K'};
+static const char INDEX_MAGIC[4] = {'G', 'L', 'P', 'I'};
+static const uint32_t PACK_VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+static const size_t FANOUT_SIZE = 256 * 4;
+static const size_t ID_SIZE = BinaryFormat::RAW_ID_SIZE;
+static const size_t OFFSET_SIZE = 8;
+static const size_t ENTRY_HEADER_SIZE = 16;
+
+// Entry kinds stored in the pack.
+static const uint32_t KIND_WHOLE = 1;
+static const uint32_t KIND_DELTA = 2;
+
+// Upper bound on the bytes kept in each pack's delta-base cache.
+static const size_t BASE_CACHE_LIMIT = 32 * 1024 * 1024;
+
+using BinaryFormat::get32;
+using BinaryFormat::get64;
+using BinaryFormat::put32;
+using BinaryFormat::put64;
+
+/** Opens the pack whose index is INDEXPATH (pack-<name>.idx), or
+ *  returns nullptr if either file is missing or malformed. */
+std::shared_ptr<const PackFile> PackFile::open(const std::string& indexPath) {
+    const std::string suffix = ".idx";
+    if (indexPath.size() <= suffix.size() ||
+        indexPath.compare(indexPath.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return nullptr;
+    }
+
+    std::shared_ptr<PackFile> pack(new PackFile());
+    pack->indexFilePath = indexPath;
+    pack->packFilePath = indexPath.substr(0, indexPath.size() - suffix.size()) + ".pack";
+    if (!pack->indexFile.open(pack->indexFilePath) || pack->indexFile.size() < HEADER_SIZE + FANOUT_SIZE ||
+        !pack->packFile.open(pack->packFilePath) || pack->packFile.size() < HEADER_SIZE) {
+        return nullptr;
+    }
+
+    const unsigned char* index = pack->indexFile.bytes();
+    const unsigned char* data = pack->packFile.bytes();
+    uint32_t n = get32(index + 8);
+    if (std::memcmp(index, INDEX_MAGIC, 4) != 0 || get32(index + 4) != PACK_VERSION ||
+        pack->indexFile.size() != HEADER_SIZE + FANOUT_SIZE + static_cast<size_t>(n) * (ID_SIZE + OFFSET_SIZE) ||
+        std::memcmp(data, PACK_MAGIC, 4) != 0 || get32(data + 4) != PACK_VERSION || get32(data + 8) != n) {
+        return nullptr;
+    }
+
+    pack->count = n;
+    pack->fanout = index + HEADER_SIZE;
+    pack->ids = pack->fanout + FANOUT_SIZE;
+    pack->offsets = pack->ids + static_cast<size_t>(n) * ID_SIZE;
+    pack->packData = data;
+    pack->packSize = pack->packFile.size();
+    return pack;
+}
+
+ObjectId PackFile::id(uint32_t index) const {
+    return ObjectId::fromRaw(ids + static_cast<size_t>(index) * ID_SIZE);
+}
+
+/** Looks up object ID; on success stores its position in INDEX. */
+bool PackFile::find(const ObjectId& objectId, uint32_t& index) const {
+    if (count == 0) return false;
+    return findRaw(objectId.data(), index);
+}
+
+/** Looks up the raw id KEY; on success stores its position in INDEX. */
+bool PackFile::findRaw(const unsigned char* key, uint32_t& index) const {
+    uint32_t lo = key[0] == 0 ? 0 : get32(fanout + 4 * (key[0] - 1));
+    uint32_t hi = get32(fanout + 4 * key[0]);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(ids + static_cast<size_t>(mid) * ID_SIZE, key, ID_SIZE);
+        if (cmp == 0) {
+            index = mid;
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool PackFile::contains(const ObjectId& objectId) const {
+    uint32_t index;
+    return find(objectId, index);
+}
+
+/** Points CONTENT at the bytes of object ID inside the mapped pack,
+ *  without copying.  Only objects stored whole can be viewed; returns
+ *  false for deltas and for objects the pack does not hold. */
+bool PackFile::view(const ObjectId& objectId, std::string_view& content) const {
+    uint32_t index;
+    if (!find(objectId, index)) return false;
+
+    uint64_t offset = get64(offsets + static_cast<size_t>(index) * OFFSET_SIZE);
+    if (offset < HEADER_SIZE || offset > packSize - ENTRY_HEADER_SIZE) return false;
+    const unsigned char* entry = packData + offset;
+    uint64_t length = get64(entry + 8);
+    if (get32(entry) != KIND_WHOLE || length > packSize - offset - ENTRY_HEADER_SIZE) return false;
+
+    content = std::string_view(reinterpret_cast<const char*>(entry + ENTRY_HEADER_SIZE), static_cast<size_t>(length));
+    return true;
+}
+
+/** Copies the contents of object ID into CONTENT, resolving deltas.
+ *  Returns false if the pack does not hold it or the entry is damaged. */
+bool PackFile::read(const ObjectId& objectId, std::string& content) const {
+    uint32_t index;
+    if (!find(objectId, index)) return false;
+    return readEntry(get64(offsets + static_cast<size_t>(index) * OFFSET_SIZE), content);
+}
+
+/** Rebuilds the object stored at OFFSET.  The chain of deltas is first
+ *  followed down to a whole object (or a cached base), then applied
+ *  back up; every intermediate result is a base and is cached. */
+bool PackFile::readEntry(uint64_t offset, std::string& content) const {
+    std::vector<std::pair<uint64_t, const unsigned char*>> chain;
+    bool found = false;
+    while (!found) {
+        if (offset < HEADER_SIZE || offset > packSize - ENTRY_HEADER_SIZE ||
+            chain.size() > MAX_DELTA_DEPTH) {
+            return false;
+        }
+        if (!chain.empty()) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto cached = baseCache.find(offset);
+            if (cached != baseCache.end()) {
+                content = cached->second;
+                break;
+            }
+        }
+
+        const unsigned char* entry = packData + offset;
+        uint64_t length = get64(entry + 8);
+        if (length > packSize - offset - ENTRY_HEADER_SIZE) return false;
+        const unsigned char* payload = entry + ENTRY_HEADER_SIZE;
+
+        uint32_t kind = get32(entry);
+        if (kind == KIND_WHOLE) {
+            content.assign(reinterpret_cast<const char*>(payload), static_cast<size_t>(length));
+            if (!chain.empty()) cacheBase(offset, content);
+            found = true;
+        } else if (kind == KIND_DELTA && length >= ID_SIZE) {
+            chain.emplace_back(offset, entry);
+            uint32_t baseIndex;
+            if (!findRaw(payload, baseIndex)) return false;
+            offset = get64(offsets + static_cast<size_t>(baseIndex) * OFFSET_SIZE);
+        } else {
+            return false;
+        }
+    }
+
+    std::string result;
+    for (size_t i = chain.size(); i-- > 0;) {
+        const unsigned char* entry = chain[i].second;
+        uint64_t length = get64(entry + 8);
+        const char* delta = reinterpret_cast<const char*>(entry + ENTRY_HEADER_SIZE + ID_SIZE);
+        if (!Delta::apply(content, delta, static_cast<size_t>(length) - ID_SIZE, result)) {
+            return false;
+        }
+        content.swap(result);
+        if (i > 0) cacheBase(chain[i].first, content);
+    }
+    return true;
+}
+
+void PackFile::cacheBase(uint64_t offset, const std::string& content) const {
+    if (content.size() > BASE_CACHE_LIMIT / 4) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (!baseCache.emplace(offset, content).second) return;
+    baseCacheOrder.push_back(offset);
+    baseCacheBytes += content.size();
+    while (baseCacheBytes > BASE_CACHE_LIMIT) {
+        auto oldest = baseCache.find(baseCacheOrder.front());
+        baseCacheBytes -= oldest->second.size();
+        baseCache.erase(oldest);
+        baseCacheOrder.pop_front();
+    }
+}
+
+std::vector<ObjectId> PackFile::allIds() const {
+    std::vector<ObjectId> result;
+    result.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        result.push_back(id(i));
+    }
+    return result;
+}
+
+/** Writes the objects IDS into a new pack in PACKDIR, in the given order
+ *  (which becomes the on-disk order), reading each one through LOAD.
+ *  Objects are streamed one at a time.  DELTABASES maps an object to a
+ *  similar one in the pack (e.g. the next version of the same file); the
+ *  object is stored as a delta against it when that is less than half
+ *  its size and the chain stays within MAX_DELTA_DEPTH.  Returns the
+ *  path of the new index, or "" if IDS is empty. */
+std::string PackFile::write(const std::string& packDir, const std::vector<ObjectId>& objectIds,
+                            const Loader& load, const std::map<ObjectId, ObjectId>& deltaBases) {
+    if (objectIds.empty()) return "";
+    Utils::createDirectories(packDir);
+
+    std::vector<ObjectId> sorted(objectIds);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    // The pack is named after the set of objects it holds.
+    SHA1::SHA hasher;
+    for (const auto& objectId : sorted) {
+        hasher.update(objectId.data(), ID_SIZE);
+    }
+    std::string stem = packDir + "/pack-" + hasher.finalize();
+
+    // Chain length each object would have; chains that would grow past
+    // MAX_DELTA_DEPTH start over with a whole object.
+    auto inPack = [&](const ObjectId& id) {
+        return std::binary_search(sorted.begin(), sorted.end(), id);
+    };
+    std::map<ObjectId, uint32_t> depths;
+    std::map<ObjectId, ObjectId> bases;
+    for (const auto& [objectId, baseId] : deltaBases) {
+        std::vector<ObjectId> path;
+        ObjectId current = objectId;
+        uint32_t depth = 0;
+        while (true) {
+            auto known = depths.find(current);
+            if (known != depths.end()) {
+                depth = known->second;
+                break;
+            }
+            auto next = deltaBases.find(current);
+            auto loop = std::find(path.begin(), path.end(), current);
+            if (next == deltaBases.end() || !inPack(current) || !inPack(next->second) || loop != path.end()) {
+                path.erase(loop, path.end());
+                depths[current] = 0;
+                break;
+            }
+            path.push_back(current);
+            current = next->second;
+        }
+        for (size_t i = path.size(); i-- > 0;) {
+            depth = (depth + 1 > MAX_DELTA_DEPTH) ? 0 : depth + 1;
+            depths[path[i]] = depth;
+            if (depth > 0) bases[path[i]] = deltaBases.at(path[i]);
+        }
+    }
+
+    std::string tmpPack = stem + ".pack.tmp";
+    std::ofstream out(tmpPack, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::invalid_argument("cannot create file");
+    }
+
+    uint32_t n = static_cast<uint32_t>(sorted.size());
+    std::string header(PACK_MAGIC, 4);
+    put32(header, PACK_VERSION);
+    put32(header, n);
+    put32(header, 0);
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    std::vector<uint64_t> offsetOf(sorted.size(), 0);
+    std::vector<bool> written(sorted.size(), false);
+    uint64_t position = HEADER_SIZE;
+    for (const auto& objectId : objectIds) {
+        size_t slot = static_cast<size_t>(std::lower_bound(sorted.begin(), sorted.end(), objectId) - sorted.begin());
+        if (written[slot]) continue;
+        written[slot] = true;
+
+        std::string content = load(objectId);
+        std::string delta;
+        auto base = bases.find(objectId);
+        if (base != bases.end()) {
+            delta = Delta::encode(load(base->second), content);
+            if (ID_SIZE + delta.size() >= content.size() / 2) {
+                delta.clear();
+            }
+        }
+
+        std::string entry;
+        if (delta.empty()) {
+            put32(entry, KIND_WHOLE);
+            put32(entry, 0);
+            put64(entry, content.size());
+        } else {
+            put32(entry, KIND_DELTA);
+            put32(entry, depths[objectId]);
+            put64(entry, ID_SIZE + delta.size());
+            entry.append(reinterpret_cast<const char*>(base->second.data()), ID_SIZE);
+            content.swap(delta);
+        }
+        out.write(entry.data(), static_cast<std::streamsize>(entry.size()));
+        out.write(content.data(), static_cast<std::streamsize>(content.size()));
+        offsetOf[slot] = position;
+        position += entry.size() + content.size();
+    }
+    out.close();
+    if (!out) {
+        throw std::invalid_argument("cannot write pack");
+    }
+
+    std::string index;
+    index.reserve(HEADER_SIZE + FANOUT_SIZE + sorted.size() * (ID_SIZE + OFFSET_SIZE));
+    index.append(INDEX_MAGIC, 4);
+    put32(index, PACK_VERSION);
+    put32(index, n);
+    put32(index, 0);
+
+    uint32_t buckets[256] = {0};
+    for (const auto& objectId : sorted) {
+        buckets[objectId.data()[0]]++;
+    }
+    uint32_t running = 0;
+    for (int b = 0; b < 256; ++b) {
+        running += buckets[b];
+        put32(index, running);
+    }
+    for (const auto& objectId : sorted) {
+        index.append(reinterpret_cast<const char*>(objectId.data()), ID_SIZE);
+    }
+    for (uint64_t offset : offsetOf) {
+        put64(index, offset);
+    }
+
+    std::rename(tmpPack.c_str(), (stem + ".pack").c_str());
+    Utils::writeContents(stem + ".idx", index);
+    return stem + ".idx";
+}
@@ -1,4 +1,6 @@
 #include "../include/Repository.h"
+#include "../include/ObjectStore.h"
+#include "../include/CommitGraph.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -49,6 +51,9 @@ void Repository::createDirectories() {
     
     std::string refsRemotes = Utils::join(Utils::join(gitliteDir, "refs"), "remotes");
     Utils::createDirectories(refsRemotes);
+    
+    // 新仓库直接使用分层（fan-out）对象目录
+    ObjectStore(Utils::join(gitliteDir, "objects")).initLayout();
 }
 
 void Repository::createInitialCommit() {
@@ -62,10 +67,10 @@ void Repository::createInitialCommit() {
     std::string commitContent = commitData.str();
     std::string commitHash = Utils::sha1(commitContent);
     
-    // 保存提交 - 使用两次join
-    std::string objectsDir = Utils::join(gitliteDir, "objects");
-    std::string commitPath = Utils::join(objectsDir, commitHash);
-    Utils::writeContents(commitPath, commitContent);
+    // 保存提交
+    ObjectStore objects(Utils::join(gitliteDir, "objects"));
+    objects.write(commitHash, commitContent);
+    CommitGraph(objects).addCommits({commitHash});
     
     // 保存HEAD文件
     std::string headPath = Utils::join(gitliteDir, "HEAD");
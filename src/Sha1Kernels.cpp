@@ -0,0 +1,271 @@
+#include "../include/Sha1Kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/** SHA-1 compression kernels.
+ *
+ * The portable kernel is fully unrolled over a 16-word circular message
+ * schedule, so there are no per-round branches and no heap buffer.  On
+ * x86 two accelerated kernels are available: one that computes the
+ * message schedule four words at a time with SSSE3, and one that uses
+ * the SHA extensions (SHA-NI) for both schedule and rounds.
+ */
+
+namespace SHA1 {
+    static const uint32_t K0 = 0x5a827999;
+    static const uint32_t K1 = 0x6ed9eba1;
+    static const uint32_t K2 = 0x8f1bbcdc;
+    static const uint32_t K3 = 0xca62c1d6;
+
+    static inline uint32_t rol(uint32_t x, int n) {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    static inline uint32_t loadBigEndian(const uint8_t* p) {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+
+// Round functions.  The five working variables rotate roles every round,
+// which the callers express by permuting the macro arguments instead of
+// shuffling values.
+#define SHA1_CH(b, c, d)     (((c ^ d) & b) ^ d)
+#define SHA1_PARITY(b, c, d) (b ^ c ^ d)
+#define SHA1_MAJ(b, c, d)    (((b | c) & d) | (b & c))
+
+#define SHA1_ROUND(f, k, a, b, c, d, e, wt) \
+    e += rol(a, 5) + f(b, c, d) + k + (wt); \
+    b = rol(b, 30);
+
+#define SHA1_SCHEDULE(t) \
+    (w[(t) & 15] = rol(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] ^ w[((t) + 2) & 15] ^ w[(t) & 15], 1))
+
+#define SHA1_FIVE(f, k, t, wt) \
+    SHA1_ROUND(f, k, a, b, c, d, e, wt(t));     \
+    SHA1_ROUND(f, k, e, a, b, c, d, wt(t + 1)); \
+    SHA1_ROUND(f, k, d, e, a, b, c, wt(t + 2)); \
+    SHA1_ROUND(f, k, c, d, e, a, b, wt(t + 3)); \
+    SHA1_ROUND(f, k, b, c, d, e, a, wt(t + 4));
+
+#define SHA1_LOADED(t) w[(t) & 15]
+
+    void compressPortable(uint32_t state[5], const uint8_t* blocks, size_t count) {
+        uint32_t w[16];
+        for (; count > 0; --count, blocks += 64) {
+            for (int i = 0; i < 16; i++) {
+                w[i] = loadBigEndian(blocks + 4 * i);
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+            SHA1_FIVE(SHA1_CH, K0, 0, SHA1_LOADED)
+            SHA1_FIVE(SHA1_CH, K0, 5, SHA1_LOADED)
+            SHA1_FIVE(SHA1_CH, K0, 10, SHA1_LOADED)
+            SHA1_ROUND(SHA1_CH, K0, a, b, c, d, e, w[15]);
+            SHA1_ROUND(SHA1_CH, K0, e, a, b, c, d, SHA1_SCHEDULE(16));
+            SHA1_ROUND(SHA1_CH, K0, d, e, a, b, c, SHA1_SCHEDULE(17));
+            SHA1_ROUND(SHA1_CH, K0, c, d, e, a, b, SHA1_SCHEDULE(18));
+            SHA1_ROUND(SHA1_CH, K0, b, c, d, e, a, SHA1_SCHEDULE(19));
+
+            SHA1_FIVE(SHA1_PARITY, K1, 20, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K1, 25, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K1, 30, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K1, 35, SHA1_SCHEDULE)
+
+            SHA1_FIVE(SHA1_MAJ, K2, 40, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_MAJ, K2, 45, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_MAJ, K2, 50, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_MAJ, K2, 55, SHA1_SCHEDULE)
+
+            SHA1_FIVE(SHA1_PARITY, K3, 60, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K3, 65, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K3, 70, SHA1_SCHEDULE)
+            SHA1_FIVE(SHA1_PARITY, K3, 75, SHA1_SCHEDULE)
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// W[t] + K[t], precomputed by the vector schedule.
+#define SHA1_PRECOMPUTED(t) wk[t]
+
+    /** Message schedule four words at a time: W[t..t+3] is built from
+     *  shifted/aligned copies of the previous sixteen words, then lane 3
+     *  is patched for its dependency on W[t], computed in the same step. */
+    __attribute__((target("ssse3")))
+    void compressSsse3(uint32_t state[5], const uint8_t* blocks, size_t count) {
+        const __m128i byteSwap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        const __m128i roundConstants[4] = {
+            _mm_set1_epi32(static_cast<int>(K0)), _mm_set1_epi32(static_cast<int>(K1)),
+            _mm_set1_epi32(static_cast<int>(K2)), _mm_set1_epi32(static_cast<int>(K3))
+        };
+        alignas(16) uint32_t wk[80];
+
+        for (; count > 0; --count, blocks += 64) {
+            __m128i w[20];
+            for (int i = 0; i < 4; i++) {
+                w[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwap);
+            }
+            for (int i = 4; i < 20; i++) {
+                __m128i x = _mm_xor_si128(_mm_srli_si128(w[i - 1], 4), w[i - 2]);
+                x = _mm_xor_si128(x, _mm_alignr_epi8(w[i - 3], w[i - 4], 8));
+                x = _mm_xor_si128(x, w[i - 4]);
+                __m128i r = _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+                __m128i fix = _mm_slli_si128(r, 12);
+                fix = _mm_or_si128(_mm_slli_epi32(fix, 1), _mm_srli_epi32(fix, 31));
+                w[i] = _mm_xor_si128(r, fix);
+            }
+            for (int i = 0; i < 20; i++) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(wk + 4 * i),
+                                _mm_add_epi32(w[i], roundConstants[i / 5]));
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+            SHA1_FIVE(SHA1_CH, 0, 0, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_CH, 0, 5, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_CH, 0, 10, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_CH, 0, 15, SHA1_PRECOMPUTED)
+
+            SHA1_FIVE(SHA1_PARITY, 0, 20, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 25, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 30, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 35, SHA1_PRECOMPUTED)
+
+            SHA1_FIVE(SHA1_MAJ, 0, 40, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_MAJ, 0, 45, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_MAJ, 0, 50, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_MAJ, 0, 55, SHA1_PRECOMPUTED)
+
+            SHA1_FIVE(SHA1_PARITY, 0, 60, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 65, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 70, SHA1_PRECOMPUTED)
+            SHA1_FIVE(SHA1_PARITY, 0, 75, SHA1_PRECOMPUTED)
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
+    }
+
+#undef SHA1_PRECOMPUTED
+
+// One group of four rounds with the SHA extensions.  Group G consumes
+// msg[G % 4], alternates between the two E registers, and overlaps the
+// schedule for later groups (msg1/xor/msg2) with the rounds.
+#define SHA1NI_GROUP(g, func)                                                  \
+    if ((g) == 0) {                                                            \
+        e[0] = _mm_add_epi32(e[0], msg[0]);                                    \
+    } else {                                                                   \
+        e[(g) % 2] = _mm_sha1nexte_epu32(e[(g) % 2], msg[(g) % 4]);            \
+    }                                                                          \
+    e[((g) + 1) % 2] = abcd;                                                   \
+    if ((g) >= 3 && (g) <= 18) {                                               \
+        msg[((g) + 1) % 4] = _mm_sha1msg2_epu32(msg[((g) + 1) % 4], msg[(g) % 4]); \
+    }                                                                          \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[(g) % 2], func);                        \
+    if ((g) >= 1 && (g) <= 16) {                                               \
+        msg[((g) + 3) % 4] = _mm_sha1msg1_epu32(msg[((g) + 3) % 4], msg[(g) % 4]); \
+    }                                                                          \
+    if ((g) >= 2 && (g) <= 17) {                                               \
+        msg[((g) + 2) % 4] = _mm_xor_si128(msg[((g) + 2) % 4], msg[(g) % 4]);  \
+    }
+
+    __attribute__((target("sha,sse4.1")))
+    void compressShaNi(uint32_t state[5], const uint8_t* blocks, size_t count) {
+        const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+        __m128i e[2];
+        e[0] = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+        e[1] = _mm_setzero_si128();
+
+        for (; count > 0; --count, blocks += 64) {
+            const __m128i abcdSave = abcd;
+            const __m128i eSave = e[0];
+            __m128i msg[4];
+            for (int i = 0; i < 4; i++) {
+                msg[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwap);
+            }
+
+            SHA1NI_GROUP(0, 0)  SHA1NI_GROUP(1, 0)  SHA1NI_GROUP(2, 0)  SHA1NI_GROUP(3, 0)
+            SHA1NI_GROUP(4, 0)  SHA1NI_GROUP(5, 1)  SHA1NI_GROUP(6, 1)  SHA1NI_GROUP(7, 1)
+            SHA1NI_GROUP(8, 1)  SHA1NI_GROUP(9, 1)  SHA1NI_GROUP(10, 2) SHA1NI_GROUP(11, 2)
+            SHA1NI_GROUP(12, 2) SHA1NI_GROUP(13, 2) SHA1NI_GROUP(14, 2) SHA1NI_GROUP(15, 3)
+            SHA1NI_GROUP(16, 3) SHA1NI_GROUP(17, 3) SHA1NI_GROUP(18, 3) SHA1NI_GROUP(19, 3)
+
+            e[0] = _mm_sha1nexte_epu32(e[0], eSave);
+            abcd = _mm_add_epi32(abcd, abcdSave);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+        state[4] = static_cast<uint32_t>(_mm_extract_epi32(e[0], 3));
+    }
+
+#undef SHA1NI_GROUP
+
+    static bool cpuHasSsse3() {
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+    }
+
+    static bool cpuHasShaNi() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+            return false;
+        }
+        return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+    }
+
+#endif
+
+#undef SHA1_LOADED
+#undef SHA1_FIVE
+#undef SHA1_SCHEDULE
+#undef SHA1_ROUND
+#undef SHA1_MAJ
+#undef SHA1_PARITY
+#undef SHA1_CH
+
+    static CompressFn detectKernel() {
+        const char* forced = std::getenv("GITLITE_SHA1_KERNEL");
+        std::string request = forced ? forced : "";
+#if defined(__x86_64__) || defined(__i386__)
+        bool shaNi = cpuHasShaNi();
+        bool ssse3 = cpuHasSsse3();
+        if (request == "portable") {
+            return compressPortable;
+        }
+        if (request == "ssse3" && ssse3) {
+            return compressSsse3;
+        }
+        if (shaNi && (request.empty() || request == "shani")) {
+            return compressShaNi;
+        }
+        if (ssse3) {
+            return compressSsse3;
+        }
+#endif
+        return compressPortable;
+    }
+
+    CompressFn selectCompress() {
+        static const CompressFn choice = detectKernel();
+        return choice;
+    }
+}
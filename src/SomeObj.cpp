@@ -1,18 +1,29 @@
 #include "../include/SomeObj.h"
 #include "../include/Utils.h"
 #include "../include/Repository.h"
-#include <iostream>
+#include "../include/ObjectStore.h"
+#include "../include/Transaction.h"
+#include "../include/CommitGraph.h"
+#include "../include/MessageIndex.h"
+#include "../include/Output.h"
+#include "../include/Commit.h"
+#include "../include/Tree.h"
+#include "../include/Manifest.h"
+#include "../include/ThreadPool.h"
+#include "../include/WorkTree.h"
+#include "../include/Index.h"
+#include "../include/FsMonitor.h"
 #include <fstream>
 #include <sstream>
 #include <set>
 #include <map>
+#include <memory_resource>
 #include <filesystem>
 #include <vector>
 #include <algorithm>
 #include <ctime>
 #include <iomanip>
 #include <queue>
-#include <functional>
 
 namespace fs = std::filesystem;
 
@@ -20,12 +31,17 @@ class SomeObj::Impl {
 private:
     std::string gitliteDir = ".gitlite";
     std::string headPath;
-    std::string objectsDir;
-    std::string stagingPath;
+    // 每条命令一个单调分配器：提交的文件列表、路径表、文件清单和索引的 stat 缓存
+    // 都从这里顺序分配，命令结束时整体释放；它不是线程安全的，只在主线程上使用
+    mutable std::pmr::monotonic_buffer_resource arena{64 * 1024};
+    ObjectStore objects{gitliteDir + "/objects"};
+    mutable CommitGraph graph{objects};
+    mutable CommitCache commits{objects, &arena};
+    Index index{gitliteDir, &arena};
     std::string remoteDir; // 远程仓库信息目录
     
     std::string currentBranch = "master";
-    std::map<std::string, std::string> stagedFiles;  // filename -> blobHash
+    std::map<std::string, ObjectId> stagedFiles;  // filename -> blobHash
     std::set<std::string> removedFiles;
     std::map<std::string, std::string> remotes; // remoteName -> remotePath
     
@@ -34,15 +50,21 @@ private:
     void saveHead();
     void loadHead();
     void saveStaging();
+    void appendStaging();
     void loadStaging();
     void saveRemotes();
     void loadRemotes();
-    std::string formatTimestamp(const std::string& utcTimestamp) const;
+    std::string_view formatTimestamp(std::string_view utcTimestamp) const;
+    const CommitGraph& commitGraph() const;
+    bool lookupCommit(const std::string& commitHash, uint32_t& index) const;
     std::vector<std::string> getAllCommitHashes() const;
     std::string expandCommitId(const std::string& shortId) const;
     void restoreFileFromCommit(const std::string& commitHash, const std::string& filename) const;
     std::string getCommitMessage(const std::string& commitHash) const;
-    void printCommitInfo(const std::string& commitHash, bool includeMergeInfo = true) const;
+    void printCommitInfo(const std::string& commitHash, bool includeMergeInfo = true,
+                         const std::string& format = "") const;
+    void renderCommit(const std::string& commitHash, const Commit& commit,
+                      const std::string& format) const;
     std::pair<std::string, std::string> getCommitParents(const std::string& commitHash) const;
 
     std::string findSplitPoint(const std::string& commit1, const std::string& commit2) const;
@@ -53,13 +75,20 @@ private:
                                        const std::string& givenCommit,
                                        const std::string& splitPoint,
                                        const std::string& branchName);
-    std::map<std::string, std::string> getCommitFiles(const std::string& commitHash) const;
+    Manifest getCommitFiles(const std::string& commitHash, PathTable& paths) const;
+    Manifest::Changes changedFiles(const std::string& fromCommit, const std::string& toCommit,
+                                   PathTable& paths) const;
     bool filesEqual(const std::string& file1, const std::string& file2) const;
+    bool queryMonitor(std::set<std::string>& changed, bool rescan);
     
     // 远程相关辅助方法
     std::string getRemoteBranchHash(const std::string& remoteName, const std::string& branchName) const;
-    void copyObjectIfNotExists(const std::string& objectHash, const std::string& remoteObjectsDir) const;
-    void copyCommitAndBlobs(const std::string& commitHash, const std::string& remoteObjectsDir) const;
+    void copyObjectIfNotExists(const ObjectId& objectHash, const ObjectStore& remoteObjects,
+                               Transaction& transaction) const;
+    void copyCommitAndBlobs(const std::string& commitHash, const ObjectStore& remoteObjects,
+                            Transaction& transaction) const;
+    void copyTreeIfNotExists(const ObjectId& treeHash, const ObjectStore& source,
+                             const ObjectStore& target, Transaction& transaction) const;
     bool isAncestor(const std::string& ancestor, const std::string& descendant) const;
     
 public:
@@ -67,12 +96,13 @@ public:
     
     void init();
     void add(const std::string& filename);
+    void add(const std::vector<std::string>& paths);
     void commit(const std::string& message, const std::string& secondParent = "");
     void rm(const std::string& filename);
     void status();
-    void log();
-    void globalLog();
-    void find(const std::string& commitMessage);
+    void log(const std::string& format = "");
+    void globalLog(size_t limit, std::time_t since, std::time_t until, const std::string& format);
+    void find(const std::string& commitMessage, bool substring = false);
     void checkoutFile(const std::string& filename);
     void checkoutFileInCommit(const std::string& commitId, const std::string& filename);
     void checkoutBranch(const std::string&);
@@ -87,17 +117,20 @@ public:
     void push(const std::string& remoteName, const std::string& branchName);
     void fetch(const std::string& remoteName, const std::string& branchName);
     void pull(const std::string& remoteName, const std::string& branchName);
+
+    // 仓库维护
+    void repack();
+    void fsmonitor(const std::string& action);
 };
 
 // ==================== 构造函数和基础方法 ====================
 
 SomeObj::Impl::Impl() {
     headPath = gitliteDir + "/HEAD";
-    objectsDir = gitliteDir + "/objects";
-    stagingPath = gitliteDir + "/STAGING";
     remoteDir = gitliteDir + "/remotes";
     
     if (Utils::exists(gitliteDir)) {
+        objects.migrateLayout();
         loadHead();
         loadStaging();
         loadRemotes();
@@ -143,42 +176,16 @@ void SomeObj::Impl::loadHead() {
 }
 
 void SomeObj::Impl::saveStaging() {
-    std::stringstream ss;
-    ss << stagedFiles.size() << "\n";
-    for (const auto& [filename, hash] : stagedFiles) {
-        ss << filename << "\n" << hash << "\n";
-    }
-    ss << removedFiles.size() << "\n";
-    for (const auto& file : removedFiles) {
-        ss << file << "\n";
-    }
-    Utils::writeContents(stagingPath, ss.str());
+    index.save(stagedFiles, removedFiles);
+}
+
+// add 与 rm 只把改动追加到索引日志，不重写整个索引
+void SomeObj::Impl::appendStaging() {
+    index.append(stagedFiles, removedFiles);
 }
 
 void SomeObj::Impl::loadStaging() {
-    if (!Utils::exists(stagingPath)) return;
-    
-    std::string content = Utils::readContentsAsString(stagingPath);
-    std::stringstream ss(content);
-    
-    stagedFiles.clear();
-    removedFiles.clear();
-    
-    size_t stagedCount, removedCount;
-    ss >> stagedCount;
-    
-    for (size_t i = 0; i < stagedCount; ++i) {
-        std::string filename, hash;
-        ss >> filename >> hash;
-        stagedFiles[filename] = hash;
-    }
-    
-    ss >> removedCount;
-    for (size_t i = 0; i < removedCount; ++i) {
-        std::string filename;
-        ss >> filename;
-        removedFiles.insert(filename);
-    }
+    index.load(stagedFiles, removedFiles);
 }
 
 void SomeObj::Impl::saveRemotes() {
@@ -232,60 +239,101 @@ void SomeObj::Impl::init() {
 }
 
 void SomeObj::Impl::add(const std::string& filename) {
-    if (!Utils::exists(filename)) {
-        Utils::exitWithMessage("File does not exist.");
-    }
-
-    // 读取文件内容并计算哈希
-    std::string content = Utils::readContentsAsString(filename);
-    std::string hash = Utils::sha1(content);
-
-    // 保存 blob 对象
-    std::string blobPath = objectsDir + "/" + hash;
-    if (!Utils::exists(blobPath)) {
-        Utils::writeContents(blobPath, content);
-    }
+    add(std::vector<std::string>{filename});
+}
 
-    // 获取当前提交哈希
-    std::string currentCommitHash = getHeadCommitHash();
-    bool sameAsCommit = false;
-
-    if (!currentCommitHash.empty() && currentCommitHash != "0") {
-        std::string commitPath = objectsDir + "/" + currentCommitHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-
-            std::string line;
-            std::getline(ss, line); // 消息
-            std::getline(ss, line); // 父提交
-            std::getline(ss, line); // 时间戳
-
-            int blobCount = 0;
-            if (ss >> blobCount) {
-                ss.ignore(); // 跳过换行
-                for (int i = 0; i < blobCount; ++i) {
-                    std::string blobHash, blobFile;
-                    if (!std::getline(ss, line)) break;
-                    std::istringstream iss(line);
-                    if (!(iss >> blobHash >> blobFile)) continue;
-                    if (blobFile == filename) {
-                        sameAsCommit = (blobHash == hash);
-                        break;
+// 一次暂存多个文件：展开通配符和目录（递归），只解析一次 HEAD 提交，
+// 在线程池中并行计算哈希并写入 blob，最后只写一次暂存区
+void SomeObj::Impl::add(const std::vector<std::string>& paths) {
+    // 有 fsmonitor 时，目录从索引中的工作区文件列表展开，未变化文件的哈希直接取缓存
+    std::set<std::string> changed;
+    bool monitored = queryMonitor(changed, false);
+    auto filesBelow = [&](const std::string& directory) {
+        if (!monitored) {
+            return WorkTree::scan(directory);
+        }
+        const std::set<std::string>& files = index.workingFiles();
+        if (directory == ".") {
+            return std::vector<std::string>(files.begin(), files.end());
+        }
+        std::string prefix = directory + "/";
+        std::vector<std::string> below;
+        for (auto it = files.lower_bound(prefix);
+             it != files.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+            below.push_back(*it);
+        }
+        return below;
+    };
+    
+    std::vector<std::string> filenames;
+    std::set<std::string> seen;
+    for (const auto& path : paths) {
+        std::vector<std::string> matches;
+        if (Utils::isGlobPattern(path) && !Utils::exists(path)) {
+            matches = Utils::expandGlob(path);
+        } else if (Utils::exists(path)) {
+            matches.push_back(path);
+        }
+        if (matches.empty()) {
+            Utils::exitWithMessage("File does not exist.");
+        }
+        for (const auto& match : matches) {
+            std::string filename = WorkTree::normalize(match);
+            if (filename.empty()) {
+                Utils::exitWithMessage("File does not exist.");
+            }
+            if (Utils::isDirectory(filename)) {
+                for (auto& file : filesBelow(filename)) {
+                    if (seen.insert(file).second) {
+                        filenames.push_back(std::move(file));
                     }
                 }
+            } else if (seen.insert(filename).second) {
+                filenames.push_back(filename);
             }
         }
     }
 
-    if (sameAsCommit) {
-        stagedFiles.erase(filename);
-    } else {
-        stagedFiles[filename] = hash;
-    }
+    // 分块读取文件并计算哈希（内存占用与文件大小无关）；
+    // stat 信息未变的文件直接使用索引中缓存的哈希，不再读取
+    ThreadPool pool(std::min(ThreadPool::defaultThreadCount(), filenames.size()));
+    std::vector<ObjectId> hashes = index.hashFiles(filenames, pool, monitored ? &changed : nullptr);
 
-    removedFiles.erase(filename);
-    saveStaging();
+    // 保存 blob 对象（相同内容只写一次）
+    std::map<ObjectId, size_t> newBlobs; // blobHash -> 来源文件下标
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (!objects.contains(hashes[i])) {
+            newBlobs.emplace(hashes[i], i);
+        }
+    }
+    std::vector<std::pair<ObjectId, size_t>> pendingBlobs(newBlobs.begin(), newBlobs.end());
+    pool.parallelFor(pendingBlobs.size(), [&](size_t i) {
+        const auto& [hash, source] = pendingBlobs[i];
+        objects.writeFromFile(hash, filenames[source]);
+    });
+
+    // 与当前提交比较（只解析一次）
+    std::shared_ptr<const Commit> head = commits.get(getHeadCommitHash());
+
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        const std::string& filename = filenames[i];
+        const Commit::File* tracked = head ? head->findFile(filename) : nullptr;
+        if (tracked != nullptr && tracked->blob == hashes[i]) {
+            if (stagedFiles.erase(filename) != 0) {
+                index.journalUnstage(filename);
+            }
+        } else {
+            auto staged = stagedFiles.find(filename);
+            if (staged == stagedFiles.end() || staged->second != hashes[i]) {
+                stagedFiles[filename] = hashes[i];
+                index.journalStage(filename, hashes[i]);
+            }
+        }
+        if (removedFiles.erase(filename) != 0) {
+            index.journalUnremove(filename);
+        }
+    }
+    appendStaging();
 }
 
 void SomeObj::Impl::commit(const std::string& message, const std::string& secondParent) {
@@ -298,90 +346,58 @@ void SomeObj::Impl::commit(const std::string& message, const std::string& second
         Utils::exitWithMessage("No changes added to the commit.");
     }
     
-    std::string parentHash = getHeadCommitHash();
-    
-    std::stringstream commitData;
-    commitData << message << "\n";
-    
-    // 写入父提交（合并提交有两个父提交）
-    if (parentHash.empty() || !Utils::exists(objectsDir + "/" + parentHash)) {
-        commitData << "0\n";
-    } else {
-        commitData << parentHash << "\n";
-    }
-    
-    // 如果是合并提交，添加第二个父提交
-    if (!secondParent.empty()) {
-        commitData << secondParent << "\n";
-    }
+    // 父提交（合并提交还有第二个父提交）
+    std::shared_ptr<const Commit> parent = commits.get(getHeadCommitHash());
+    std::string parentHash = parent ? parent->id() : "";
     
     // 时间戳
     std::time_t now = std::time(nullptr);
     std::tm* gmt = std::gmtime(&now);
     char timeBuffer[100];
     std::strftime(timeBuffer, sizeof(timeBuffer), "%a %b %d %H:%M:%S %Y +0000", gmt);
-    commitData << timeBuffer << "\n";
-    
-    // 收集blob信息
-    std::map<std::string, std::string> blobs;
     
-    // 从第一个父提交继承blob（如果存在且不是初始提交）
-    if (!parentHash.empty() && parentHash != "0") {
-        std::string commitPath = objectsDir + "/" + parentHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-            
-            // 跳过消息行
-            std::string line;
-            std::getline(ss, line);  // 消息
-            
-            // 跳过父提交行（可能有两行）
-            std::getline(ss, line);  // 第一个父提交
-            // 检查是否有第二个父提交
-            std::getline(ss, line);
-            if (line.find(":") == std::string::npos) {
-                // 这是第二个父提交，跳过时间戳行
-                std::getline(ss, line);
-            }
-            // 现在line是时间戳
-            
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, blobFile;
-                ss >> blobHash >> blobFile;
-                blobs[blobFile] = blobHash;
+    // 在第一个父提交的树上应用暂存区：只重写被修改路径上的树，
+    // 其余子树按哈希直接复用（旧格式的父提交先整体建树）
+    std::map<std::string, ObjectId> changes(stagedFiles.begin(), stagedFiles.end());
+    for (const auto& filename : removedFiles) {
+        changes[filename] = ObjectId();
+    }
+    std::vector<ObjectId> newTrees;
+    ObjectId rootTree;
+    if (parent && !parent->tree().isNull()) {
+        rootTree = Tree::update(objects, parent->tree(), changes, newTrees);
+    } else {
+        std::map<std::string, ObjectId> blobs;
+        if (parent) {
+            blobs = parent->fileMap();
+        }
+        for (const auto& [filename, hash] : changes) {
+            if (hash.isNull()) {
+                blobs.erase(filename);
+            } else {
+                blobs[filename] = hash;
             }
         }
+        rootTree = Tree::build(objects, blobs, newTrees);
     }
     
-    // 添加暂存的文件
+    // 保存提交；暂存的 blob、新的树与提交对象一起落盘
+    Transaction transaction(gitliteDir);
     for (const auto& [filename, hash] : stagedFiles) {
-        blobs[filename] = hash;
-    }
-    
-    // 移除标记为删除的文件
-    for (const auto& filename : removedFiles) {
-        blobs.erase(filename);
+        transaction.add(objects.path(hash));
     }
-    
-    // 写入blob数量和信息
-    commitData << blobs.size() << "\n";
-    for (const auto& [filename, hash] : blobs) {
-        commitData << hash << " " << filename << "\n";
+    for (const auto& treeId : newTrees) {
+        transaction.add(objects.path(treeId));
     }
-    
-    // 保存提交
-    std::string commitContent = commitData.str();
+    std::string commitContent = Commit::format(message, parentHash, secondParent, timeBuffer, rootTree);
     std::string commitHash = Utils::sha1(commitContent);
-    std::string commitPath = objectsDir + "/" + commitHash;
-    Utils::writeContents(commitPath, commitContent);
+    objects.write(commitHash, commitContent);
+    transaction.add(objects.path(commitHash));
+    graph.addCommits({commitHash});
     
-    // 更新分支引用
+    // 所有对象落盘后再更新分支引用
     std::string branchPath = gitliteDir + "/refs/heads/" + currentBranch;
-    Utils::writeContents(branchPath, commitHash + "\n");
+    transaction.updateRef(branchPath, commitHash);
     
     // 清空暂存区
     stagedFiles.clear();
@@ -389,33 +405,11 @@ void SomeObj::Impl::commit(const std::string& message, const std::string& second
     saveStaging();
 }
 
-void SomeObj::Impl::rm(const std::string& filename) {
+void SomeObj::Impl::rm(const std::string& path) {
+    std::string filename = WorkTree::normalize(path);
     bool isStaged = (stagedFiles.find(filename) != stagedFiles.end());
-    bool isTracked = false;
-    
-    std::string currentCommitHash = getHeadCommitHash();
-    if (!currentCommitHash.empty() && currentCommitHash != "0") {
-        std::string commitPath = objectsDir + "/" + currentCommitHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-            std::string line;
-            
-            for (int i = 0; i < 3; ++i) std::getline(ss, line);
-            
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, blobFile;
-                ss >> blobHash >> blobFile;
-                if (blobFile == filename) {
-                    isTracked = true;
-                    break;
-                }
-            }
-        }
-    }
+    std::shared_ptr<const Commit> head = commits.get(getHeadCommitHash());
+    bool isTracked = head && head->findFile(filename) != nullptr;
     
     if (!isStaged && !isTracked) {
         Utils::exitWithMessage("No reason to remove the file.");
@@ -423,178 +417,210 @@ void SomeObj::Impl::rm(const std::string& filename) {
     
     if (isStaged) {
         stagedFiles.erase(filename);
+        index.journalUnstage(filename);
     }
     
     if (isTracked) {
         removedFiles.insert(filename);
+        index.journalRemove(filename);
         // 删除工作目录中的文件
         if (Utils::exists(filename)) {
             Utils::restrictedDelete(filename);
         }
     }
     
-    saveStaging();
+    appendStaging();
 }
 
 // ==================== Subtask2 辅助方法 ====================
 
-std::string SomeObj::Impl::formatTimestamp(const std::string& utcTimestamp) const {
+std::string_view SomeObj::Impl::formatTimestamp(std::string_view utcTimestamp) const {
     // 直接返回UTC时间戳，不进行转换
     // 初始提交的时间戳已经是UTC时间
     return utcTimestamp;
 }
 
+// 提交图：首次使用时映射（或从松散对象重建）
+const CommitGraph& SomeObj::Impl::commitGraph() const {
+    graph.ensureLoaded();
+    return graph;
+}
+
 std::vector<std::string> SomeObj::Impl::getAllCommitHashes() const {
-    std::vector<std::string> commits;
-    if (!Utils::exists(objectsDir)) return commits;
-    
-    for (const auto& entry : fs::directory_iterator(objectsDir)) {
-        std::string filename = entry.path().filename().string();
-        if (filename.length() == 40) {
-            commits.push_back(filename);
-        }
-    }
-    return commits;
+    // 只返回提交（不包含blob），无需打开任何对象文件
+    return commitGraph().allIds();
 }
 
+// 在提交图的有序 id 表中二分查找短 id，只考虑提交（不会匹配到 blob）；
+// 匹配多个提交时报错退出，找不到时返回空串
 std::string SomeObj::Impl::expandCommitId(const std::string& shortId) const {
     if (shortId.length() == 40) return shortId;
-    
-    std::vector<std::string> allCommits = getAllCommitHashes();
-    for (const auto& commitHash : allCommits) {
-        if (commitHash.find(shortId) == 0) {
-            return commitHash;
-        }
+
+    const CommitGraph& g = commitGraph();
+    uint32_t index;
+    int matches = g.findPrefix(shortId, index);
+    if (matches > 1) {
+        Utils::exitWithMessage("Ambiguous commit id.");
     }
-    return "";
+    return matches == 1 ? g.id(index) : "";
 }
 
 std::string SomeObj::Impl::getCommitMessage(const std::string& commitHash) const {
-    std::string commitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(commitPath)) return "";
-    
-    std::string content = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(content);
-    std::string message;
-    std::getline(ss, message);
-    return message;
+    std::shared_ptr<const Commit> commit = commits.get(commitHash);
+    return commit ? std::string(commit->message()) : "";
 }
 
 std::pair<std::string, std::string> SomeObj::Impl::getCommitParents(const std::string& commitHash) const {
     std::pair<std::string, std::string> parents("", "");
     
-    std::string commitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(commitPath)) return parents;
-    
-    std::string content = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(content);
-    
-    std::string line;
-    std::getline(ss, line); // 跳过消息
-    
-    // 读取第一个父提交
-    std::getline(ss, line);
-    if (!line.empty() && line != "0") {
-        parents.first = line;
+    // 优先从提交图读取
+    const CommitGraph& g = commitGraph();
+    uint32_t index;
+    if (g.find(commitHash, index)) {
+        uint32_t p1 = g.parent(index, 0);
+        uint32_t p2 = g.parent(index, 1);
+        if (p1 != CommitGraph::NONE) parents.first = g.id(p1);
+        if (p2 != CommitGraph::NONE) parents.second = g.id(p2);
+        return parents;
     }
     
-    // 检查是否有第二个父提交
-    std::getline(ss, line);
-    if (line.find(":") == std::string::npos) { // 不是时间戳
-        if (!line.empty() && line != "0") {
-            parents.second = line;
-        }
+    std::shared_ptr<const Commit> commit = commits.get(commitHash);
+    if (commit) {
+        parents.first = std::string(commit->parent1());
+        parents.second = std::string(commit->parent2());
     }
-    
     return parents;
 }
 
-void SomeObj::Impl::printCommitInfo(const std::string& commitHash, bool includeMergeInfo) const {
-    std::string commitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(commitPath)) return;
-    
-    std::string content = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(content);
-    
-    std::string message, parent1, line;
-    std::getline(ss, message);
-    std::getline(ss, parent1);
-    std::getline(ss, line);
-    
-    bool isMerge = false;
-    std::string parent2, timestamp;
-    
-    // 检查是否是合并提交
-    if (line.find(":") == std::string::npos) {
-        isMerge = true;
-        parent2 = line;
-        std::getline(ss, timestamp);
-    } else {
-        timestamp = line;
+// 直接写入输出缓冲区，不拼接中间字符串；FORMAT 非空时按占位符渲染
+void SomeObj::Impl::printCommitInfo(const std::string& commitHash, bool includeMergeInfo,
+                                    const std::string& format) const {
+    std::shared_ptr<const Commit> commit = commits.get(commitHash);
+    if (!commit) return;
+    if (!format.empty()) {
+        renderCommit(commitHash, *commit, format);
+        return;
     }
-    
-    std::cout << "===" << std::endl;
-    std::cout << "commit " << commitHash << std::endl;
-    
-    if (isMerge && includeMergeInfo) {
-        std::string parent1Short = (parent1.length() >= 7) ? parent1.substr(0, 7) : parent1;
-        std::string parent2Short = (parent2.length() >= 7) ? parent2.substr(0, 7) : parent2;
-        std::cout << "Merge: " << parent1Short << " " << parent2Short << std::endl;
+
+    Output& out = Output::standard();
+    out << "===\ncommit " << commitHash << '\n';
+    if (commit->isMerge() && includeMergeInfo) {
+        out << "Merge: " << commit->parent1().substr(0, 7) << ' '
+            << commit->parent2().substr(0, 7) << '\n';
     }
-    
-    std::string formattedTimestamp = formatTimestamp(timestamp);
-    std::cout << "Date: " << formattedTimestamp << std::endl;
-    std::cout << message << std::endl;
-    std::cout << std::endl;
+    out << "Date: " << formatTimestamp(commit->timestamp()) << '\n';
+    out << commit->message() << "\n\n";
 }
 
-void SomeObj::Impl::restoreFileFromCommit(const std::string& commitHash, const std::string& filename) const {
-    std::string commitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(commitPath)) {
-        Utils::exitWithMessage("No commit with that id exists.");
-    }
-    
-    std::string content = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(content);
-    
-    std::string line;
-    for (int i = 0; i < 3; ++i) std::getline(ss, line);
-    
-    int blobCount;
-    ss >> blobCount;
-    
-    std::string blobHash;
-    bool found = false;
-    
-    for (int i = 0; i < blobCount; ++i) {
-        std::string currentHash, currentFile;
-        ss >> currentHash >> currentFile;
-        if (currentFile == filename) {
-            blobHash = currentHash;
-            found = true;
-            break;
+// --format 占位符：%H 完整 id，%h 短 id，%P / %p 父提交（完整 / 短），%ad 日期，
+// %at 秒级时间戳，%s 提交信息，%n 换行，%% 百分号；其余原样输出，每个提交末尾换行
+void SomeObj::Impl::renderCommit(const std::string& commitHash, const Commit& commit,
+                                 const std::string& format) const {
+    Output& out = Output::standard();
+    std::string_view rest(format);
+    for (size_t percent; (percent = rest.find('%')) != std::string_view::npos;) {
+        out << rest.substr(0, percent);
+        rest.remove_prefix(percent + 1);
+        std::string_view spec = rest.substr(0, rest.size() >= 2 && rest[0] == 'a' ? 2 : 1);
+        if (spec == "H") {
+            out << commitHash;
+        } else if (spec == "h") {
+            out << std::string_view(commitHash).substr(0, 7);
+        } else if (spec == "P" || spec == "p") {
+            size_t length = spec == "P" ? std::string_view::npos : 7;
+            out << commit.parent1().substr(0, length);
+            if (commit.isMerge()) {
+                out << ' ' << commit.parent2().substr(0, length);
+            }
+        } else if (spec == "ad") {
+            out << formatTimestamp(commit.timestamp());
+        } else if (spec == "at") {
+            out << static_cast<int64_t>(commit.time());
+        } else if (spec == "s") {
+            out << commit.message();
+        } else if (spec == "n") {
+            out << '\n';
+        } else if (spec == "%") {
+            out << '%';
+        } else {
+            out << '%';
+            continue;
         }
+        rest.remove_prefix(spec.size());
+    }
+    out << rest << '\n';
+}
+
+void SomeObj::Impl::restoreFileFromCommit(const std::string& commitHash, const std::string& path) const {
+    std::shared_ptr<const Commit> commit = commits.get(commitHash);
+    if (!commit) {
+        Utils::exitWithMessage("No commit with that id exists.");
     }
     
-    if (!found) {
+    std::string filename = WorkTree::normalize(path);
+    const Commit::File* file = commit->findFile(filename);
+    if (file == nullptr) {
         Utils::exitWithMessage("File does not exist in that commit.");
     }
     
-    std::string blobPath = objectsDir + "/" + blobHash;
-    if (!Utils::exists(blobPath)) {
+    if (!objects.contains(file->blob)) {
         Utils::exitWithMessage("Blob not found.");
     }
     
-    std::string fileContent = Utils::readContentsAsString(blobPath);
-    Utils::writeContents(filename, fileContent);
+    objects.copyTo(file->blob, filename);
 }
 
 // ==================== 改进的status方法 ====================
 
+// 向 fsmonitor 查询上次记录的令牌之后变化的路径，并据此更新索引中的工作区文件列表，
+// 变化的文件（目录展开为其中的文件）放入 CHANGED，其余文件的缓存哈希无需 stat 即可信任。
+// 没有守护进程或令牌失效时返回 false；若 RESCAN 为 true，此时完整扫描工作区并记录新的令牌
+bool SomeObj::Impl::queryMonitor(std::set<std::string>& changed, bool rescan) {
+    std::string token;
+    std::vector<std::string> paths;
+    FsMonitor::Answer answer = FsMonitor::query(gitliteDir, index.monitorToken(), token, paths);
+    std::set<std::string>& files = index.workingFiles();
+    
+    if (answer != FsMonitor::Answer::CHANGES) {
+        if (rescan) {
+            // 目录的 mtime 未变时直接使用索引中缓存的目录列表，不再读取目录
+            std::vector<std::string> scanned =
+                WorkTree::scan(".", ThreadPool::defaultThreadCount(), &index.untrackedCache());
+            files = std::set<std::string>(scanned.begin(), scanned.end());
+            if (answer == FsMonitor::Answer::RESCAN) {
+                // 令牌之前缓存的条目必须重新核对，之后的变化由守护进程报告
+                index.revalidate();
+                index.setMonitorToken(token);
+            } else {
+                index.setMonitorToken("");
+            }
+        }
+        return false;
+    }
+    
+    for (const auto& path : paths) {
+        index.invalidate(path);
+        files.erase(path);
+        std::string prefix = path + "/";
+        for (auto it = files.lower_bound(prefix);
+             it != files.end() && it->compare(0, prefix.size(), prefix) == 0;) {
+            it = files.erase(it);
+        }
+        for (auto& file : WorkTree::scanPath(path)) {
+            changed.insert(file);
+            files.insert(std::move(file));
+        }
+    }
+    index.setMonitorToken(token);
+    return true;
+}
+
 void SomeObj::Impl::status() {
+    Output& out = Output::standard();
+
     // === Branches ===
-    std::cout << "=== Branches ===" << std::endl;
-    std::cout << "*" << currentBranch << std::endl;
+    out << "=== Branches ===\n";
+    out << '*' << currentBranch << '\n';
     
     std::string branchesDir = gitliteDir + "/refs/heads";
     if (Utils::exists(branchesDir)) {
@@ -606,84 +632,70 @@ void SomeObj::Impl::status() {
             }
         }
         for (const auto& branchName : otherBranches) {
-            std::cout << branchName << std::endl;
+            out << branchName << '\n';
         }
     }
     
     // === Staged Files ===
-    std::cout << std::endl << "=== Staged Files ===" << std::endl;
+    out << "\n=== Staged Files ===\n";
     std::set<std::string> stagedFileNames;
     for (const auto& [filename, hash] : stagedFiles) {
         stagedFileNames.insert(filename);
     }
     for (const auto& filename : stagedFileNames) {
-        std::cout << filename << std::endl;
+        out << filename << '\n';
     }
     
     // === Removed Files ===
-    std::cout << std::endl << "=== Removed Files ===" << std::endl;
+    out << "\n=== Removed Files ===\n";
     std::set<std::string> removedFileSet(removedFiles.begin(), removedFiles.end());
     for (const auto& filename : removedFileSet) {
-        std::cout << filename << std::endl;
+        out << filename << '\n';
     }
     
     // === Modifications Not Staged For Commit ===
-    std::cout << std::endl << "=== Modifications Not Staged For Commit ===" << std::endl;
+    out << "\n=== Modifications Not Staged For Commit ===\n";
     
-    // 获取当前提交的文件
-    std::string currentCommitHash = getHeadCommitHash();
-    std::map<std::string, std::string> commitFiles;
+    // 获取当前提交的文件（按文件名排序的数组，查找用二分）
+    static const Commit::FileList noFiles;
+    std::shared_ptr<const Commit> head = commits.get(getHeadCommitHash());
+    const Commit::FileList& commitFiles = head ? head->files() : noFiles;
     
-    if (!currentCommitHash.empty() && currentCommitHash != "0") {
-        commitFiles = getCommitFiles(currentCommitHash);
-    }
-    
-    // 获取工作目录中所有普通文件
-    std::set<std::string> workingDirFiles;
-    try {
-        for (const auto& entry : fs::directory_iterator(".")) {
-            if (entry.is_regular_file()) {
-                std::string filename = entry.path().filename().string();
-                if (filename != ".gitlite" && filename[0] != '.') {
-                    workingDirFiles.insert(filename);
-                }
-            }
-        }
-    } catch (...) {
-        // 忽略错误
-    }
+    // 获取工作目录中所有普通文件：有 fsmonitor 时只重新检查变化的路径，
+    // 否则递归并行扫描子目录
+    std::set<std::string> changed;
+    bool monitored = queryMonitor(changed, true);
+    const std::set<std::string>& workingDirFiles = index.workingFiles();
     
     std::set<std::string> modifications;
     
     // 1. 在当前提交中跟踪，在工作目录中更改，但未暂存
-    for (const auto& [filename, commitHash] : commitFiles) {
-        if (workingDirFiles.find(filename) != workingDirFiles.end()) {
-            // 文件在工作目录中存在
-            std::string workingContent = Utils::readContentsAsString(filename);
-            std::string workingHash = Utils::sha1(workingContent);
-            
-            // 检查是否在暂存区
-            bool isStaged = (stagedFiles.find(filename) != stagedFiles.end());
-            
-            if (!isStaged) {
-                // 不在暂存区，且内容与提交不同
-                if (workingHash != commitHash) {
-                    modifications.insert(filename + " (modified)");
-                }
-            }
+    // 2. 已保存在添加暂存区，但内容与工作目录不同
+    // 先收集需要比较内容的文件（未暂存的与提交比较，已暂存的与暂存区比较），
+    // 再在线程池中并行 stat 和计算哈希；结果按下标写回，输出顺序不受调度影响
+    std::vector<std::string> candidates;
+    std::vector<ObjectId> expected;
+    for (const auto& file : commitFiles) {
+        std::string filename(file.filename);
+        if (workingDirFiles.find(filename) != workingDirFiles.end() &&
+            stagedFiles.find(filename) == stagedFiles.end()) {
+            candidates.push_back(filename);
+            expected.push_back(file.blob);
         }
     }
-    
-    // 2. 已保存在添加暂存区，但内容与工作目录不同
     for (const auto& [filename, stagedHash] : stagedFiles) {
         if (workingDirFiles.find(filename) != workingDirFiles.end()) {
-            // 文件在工作目录中存在
-            std::string workingContent = Utils::readContentsAsString(filename);
-            std::string workingHash = Utils::sha1(workingContent);
-            
-            if (workingHash != stagedHash) {
-                modifications.insert(filename + " (modified)");
-            }
+            candidates.push_back(filename);
+            expected.push_back(stagedHash);
+        }
+    }
+    
+    ThreadPool pool(std::min(ThreadPool::defaultThreadCount(), candidates.size()));
+    std::vector<ObjectId> workingHashes =
+        index.hashFiles(candidates, pool, monitored ? &changed : nullptr);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (workingHashes[i] != expected[i]) {
+            modifications.insert(candidates[i] + " (modified)");
         }
     }
     
@@ -696,7 +708,8 @@ void SomeObj::Impl::status() {
     }
     
     // 4. 未在删除暂存区，但在当前提交中被跟踪并已从工作目录中删除
-    for (const auto& [filename, commitHash] : commitFiles) {
+    for (const auto& file : commitFiles) {
+        std::string filename(file.filename);
         if (workingDirFiles.find(filename) == workingDirFiles.end()) {
             // 文件不在工作目录中
             bool isStaged = (stagedFiles.find(filename) != stagedFiles.end());
@@ -708,19 +721,25 @@ void SomeObj::Impl::status() {
         }
     }
     
+    // 刷新索引中的 stat 缓存和工作区文件列表，有变化时才写回
+    index.retain(workingDirFiles);
+    if (index.changed()) {
+        saveStaging();
+    }
+    
     // 输出修改
     for (const auto& modification : modifications) {
-        std::cout << modification << std::endl;
+        out << modification << '\n';
     }
     
     // === Untracked Files ===
-    std::cout << std::endl << "=== Untracked Files ===" << std::endl;
+    out << "\n=== Untracked Files ===\n";
     
     std::set<std::string> untrackedFiles;
     
     for (const auto& filename : workingDirFiles) {
         // 检查是否在提交中
-        bool inCommit = (commitFiles.find(filename) != commitFiles.end());
+        bool inCommit = head && head->findFile(filename) != nullptr;
         
         // 检查是否在暂存区
         bool inStaged = (stagedFiles.find(filename) != stagedFiles.end());
@@ -741,47 +760,54 @@ void SomeObj::Impl::status() {
     
     // 输出未跟踪文件
     for (const auto& filename : untrackedFiles) {
-        std::cout << filename << std::endl;
+        out << filename << '\n';
     }
 }
 
 // ==================== Subtask2 主要方法 ====================
 
-void SomeObj::Impl::log() {
+void SomeObj::Impl::log(const std::string& format) {
     std::string commitHash = getHeadCommitHash();
     
     while (!commitHash.empty() && commitHash != "0") {
-        printCommitInfo(commitHash, true);
+        printCommitInfo(commitHash, true, format);
         
         auto parents = getCommitParents(commitHash);
         commitHash = parents.first; // 只跟随第一个父提交
     }
 }
 
-void SomeObj::Impl::globalLog() {
-    std::vector<std::string> allCommits = getAllCommitHashes();
-    for (const auto& commitHash : allCommits) {
-        printCommitInfo(commitHash, true);
+// 按提交时间从新到旧输出：提交图里存有按时间排序的位置表，先二分跳过 UNTIL 之后的提交，
+// 打印满 LIMIT 条或遇到早于 SINCE 的提交即停止，只读取被打印的提交对象
+void SomeObj::Impl::globalLog(size_t limit, std::time_t since, std::time_t until,
+                              const std::string& format) {
+    const CommitGraph& g = commitGraph();
+    size_t printed = 0;
+    for (uint32_t rank = g.firstRankUntil(until); rank < g.size() && printed < limit; ++rank) {
+        uint32_t index = g.byTime(rank);
+        if (g.commitTime(index) < since) {
+            break;
+        }
+        printCommitInfo(g.id(index), true, format);
+        ++printed;
     }
 }
 
-void SomeObj::Impl::find(const std::string& commitMessage) {
-    std::vector<std::string> allCommits = getAllCommitHashes();
-    std::vector<std::string> matchingCommits;
-    
-    for (const auto& commitHash : allCommits) {
-        std::string message = getCommitMessage(commitHash);
-        if (message == commitMessage) {
-            matchingCommits.push_back(commitHash);
-        }
-    }
-    
+// 通过提交信息索引查找：精确匹配走哈希表，--substring 走三元组倒排表，
+// 只有索引缺失时才会读取全部提交对象
+void SomeObj::Impl::find(const std::string& commitMessage, bool substring) {
+    MessageIndex messages(objects);
+    messages.ensureLoaded(commitGraph());
+    std::vector<ObjectId> matchingCommits =
+        substring ? messages.substring(commitMessage) : messages.exact(commitMessage);
+
     if (matchingCommits.empty()) {
         Utils::exitWithMessage("Found no commit with that message.");
     }
-    
-    for (const auto& commitHash : matchingCommits) {
-        std::cout << commitHash << std::endl;
+
+    Output& out = Output::standard();
+    for (const auto& commitId : matchingCommits) {
+        out << commitId << '\n';
     }
 }
 
@@ -832,52 +858,20 @@ void SomeObj::Impl::checkoutBranch(const std::string& branchName) {
     std::string currentCommitHash = getHeadCommitHash();
     
     // 获取目标提交的文件列表
+    std::shared_ptr<const Commit> target = commits.get(targetCommitHash);
     std::set<std::string> targetFiles;
-    if (!targetCommitHash.empty() && targetCommitHash != "0") {
-        std::string commitPath = objectsDir + "/" + targetCommitHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-            
-            // 跳过前三行
-            std::string line;
-            std::getline(ss, line);  // 消息
-            std::getline(ss, line);  // 父提交
-            std::getline(ss, line);  // 时间戳
-            
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, blobFile;
-                ss >> blobHash >> blobFile;
-                targetFiles.insert(blobFile);
-            }
+    if (target) {
+        for (const auto& file : target->files()) {
+            targetFiles.emplace(file.filename);
         }
     }
     
     // 获取当前提交的文件列表
+    std::shared_ptr<const Commit> current = commits.get(currentCommitHash);
     std::set<std::string> currentFiles;
-    if (!currentCommitHash.empty() && currentCommitHash != "0") {
-        std::string commitPath = objectsDir + "/" + currentCommitHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-            
-            // 跳过前三行
-            std::string line;
-            std::getline(ss, line);  // 消息
-            std::getline(ss, line);  // 父提交
-            std::getline(ss, line);  // 时间戳
-            
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, blobFile;
-                ss >> blobHash >> blobFile;
-                currentFiles.insert(blobFile);
-            }
+    if (current) {
+        for (const auto& file : current->files()) {
+            currentFiles.emplace(file.filename);
         }
     }
     
@@ -892,12 +886,8 @@ void SomeObj::Impl::checkoutBranch(const std::string& branchName) {
         }
     }
     
-    // 恢复目标提交的所有文件
-    for (const auto& filename : targetFiles) {
-        restoreFileFromCommit(targetCommitHash, filename);
-    }
-    
     // 删除在当前分支中存在但在目标分支中不存在的文件
+    // （先删除，使被目录取代的文件让出路径）
     for (const auto& filename : currentFiles) {
         if (targetFiles.find(filename) == targetFiles.end()) {
             if (Utils::exists(filename)) {
@@ -906,6 +896,22 @@ void SomeObj::Impl::checkoutBranch(const std::string& branchName) {
         }
     }
     
+    // 恢复目标提交的文件。两个提交中内容相同、且工作区副本未被修改的文件无需重写
+    // （有 fsmonitor 时，未报告变化的文件不必 stat）
+    std::set<std::string> changed;
+    bool monitored = queryMonitor(changed, false);
+    if (target) {
+        for (const auto& file : target->files()) {
+            std::string filename(file.filename);
+            const Commit::File* tracked = current ? current->findFile(filename) : nullptr;
+            if (tracked != nullptr && tracked->blob == file.blob && Utils::isFile(filename) &&
+                index.hashFile(filename, monitored && changed.count(filename) == 0) == file.blob) {
+                continue;
+            }
+            restoreFileFromCommit(targetCommitHash, filename);
+        }
+    }
+    
     // 更新当前分支
     // 注意：对于远程分支格式（如 R1/master），我们也将其设置为当前分支
     currentBranch = branchName;
@@ -930,7 +936,7 @@ void SomeObj::Impl::branch(const std::string& branchName) {
     std::string currentCommitHash = getHeadCommitHash();
     
     // 3. 创建新分支指向当前提交
-    Utils::writeContents(branchPath, currentCommitHash + "\n");
+    Transaction(gitliteDir).updateRef(branchPath, currentCommitHash);
 }
 
 void SomeObj::Impl::rmBranch(const std::string& branchName) {
@@ -971,8 +977,8 @@ void SomeObj::Impl::reset(const std::string& commitId) {
     }
     
     //  验证提交存在
-    std::string commitPath = objectsDir + "/" + fullCommitId;
-    if (!Utils::exists(commitPath)) {
+    std::shared_ptr<const Commit> target = commits.get(fullCommitId);
+    if (!target) {
         Utils::exitWithMessage("No commit with that id exists.");
     }
     
@@ -981,45 +987,15 @@ void SomeObj::Impl::reset(const std::string& commitId) {
     
     //  获取目标提交的文件列表
     std::set<std::string> targetFiles;
-    std::string commitContent = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(commitContent);
-    
-    // 跳过前三行
-    std::string line;
-    std::getline(ss, line);  // 消息
-    std::getline(ss, line);  // 父提交
-    std::getline(ss, line);  // 时间戳
-    
-    int blobCount;
-    ss >> blobCount;
-    
-    for (int i = 0; i < blobCount; ++i) {
-        std::string blobHash, blobFile;
-        ss >> blobHash >> blobFile;
-        targetFiles.insert(blobFile);
+    for (const auto& file : target->files()) {
+        targetFiles.emplace(file.filename);
     }
     
     //  获取当前提交的文件列表
     std::set<std::string> currentFiles;
-    if (!currentCommitHash.empty() && currentCommitHash != "0") {
-        std::string currentCommitPath = objectsDir + "/" + currentCommitHash;
-        if (Utils::exists(currentCommitPath)) {
-            std::string currentCommitContent = Utils::readContentsAsString(currentCommitPath);
-            std::stringstream ssCurrent(currentCommitContent);
-            
-            // 跳过前三行
-            std::getline(ssCurrent, line);  // 消息
-            std::getline(ssCurrent, line);  // 父提交
-            std::getline(ssCurrent, line);  // 时间戳
-            
-            int currentBlobCount;
-            ssCurrent >> currentBlobCount;
-            
-            for (int i = 0; i < currentBlobCount; ++i) {
-                std::string blobHash, blobFile;
-                ssCurrent >> blobHash >> blobFile;
-                currentFiles.insert(blobFile);
-            }
+    if (auto current = commits.get(currentCommitHash)) {
+        for (const auto& file : current->files()) {
+            currentFiles.emplace(file.filename);
         }
     }
     
@@ -1034,12 +1010,8 @@ void SomeObj::Impl::reset(const std::string& commitId) {
         }
     }
     
-    //  恢复目标提交的所有文件
-    for (const auto& filename : targetFiles) {
-        restoreFileFromCommit(fullCommitId, filename);
-    }
-    
     //  删除在当前分支中存在但在目标提交中不存在的文件
+    //  （先删除，使被目录取代的文件让出路径）
     for (const auto& filename : currentFiles) {
         if (targetFiles.find(filename) == targetFiles.end()) {
             if (Utils::exists(filename)) {
@@ -1048,9 +1020,14 @@ void SomeObj::Impl::reset(const std::string& commitId) {
         }
     }
     
+    //  恢复目标提交的所有文件
+    for (const auto& filename : targetFiles) {
+        restoreFileFromCommit(fullCommitId, filename);
+    }
+    
     //  更新当前分支指向目标提交
     std::string branchPath = gitliteDir + "/refs/heads/" + currentBranch;
-    Utils::writeContents(branchPath, fullCommitId + "\n");
+    Transaction(gitliteDir).updateRef(branchPath, fullCommitId);
     
     //  清空暂存区
     stagedFiles.clear();
@@ -1059,141 +1036,63 @@ void SomeObj::Impl::reset(const std::string& commitId) {
 }
 
 // ==================== Subtask5 辅助方法 ====================
-// 寻找两个提交的最低公共祖先
+// 在提交图中定位提交；图中没有时（例如由旧版本写入）先补充再查找
+bool SomeObj::Impl::lookupCommit(const std::string& commitHash, uint32_t& index) const {
+    if (commitHash.empty() || commitHash == "0") return false;
+    if (commitGraph().find(commitHash, index)) return true;
+    graph.addCommits({commitHash});
+    return graph.find(commitHash, index);
+}
+
+// 寻找两个提交的最低公共祖先（基于代数的双向染色，无深度限制）
 std::string SomeObj::Impl::findSplitPoint(const std::string& commit1, const std::string& commit2) const {
-    // 使用深度优先搜索找到所有祖先
-    std::function<void(const std::string&, std::set<std::string>&, int)> collectAncestors = 
-        [&](const std::string& commit, std::set<std::string>& ancestors, int depth) {
-            if (commit.empty() || commit == "0" || depth > 100) return;
-            
-            ancestors.insert(commit);
-            
-            std::string commitPath = objectsDir + "/" + commit;
-            if (!Utils::exists(commitPath)) return;
-            
-            std::string content = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(content);
-            
-            // 跳过消息
-            std::string line;
-            std::getline(ss, line);
-            
-            // 读取父提交
-            std::getline(ss, line);
-            std::string parent1 = line;
-            
-            // 检查是否有第二个父提交
-            std::string parent2 = "";
-            std::getline(ss, line);
-            if (line.find(":") == std::string::npos) {
-                parent2 = line;
-            }
-            
-            // 递归处理父提交
-            if (!parent1.empty() && parent1 != "0") {
-                collectAncestors(parent1, ancestors, depth + 1);
-            }
-            if (!parent2.empty() && parent2 != "0") {
-                collectAncestors(parent2, ancestors, depth + 1);
-            }
-        };
-    
-    // 收集commit1的所有祖先
-    std::set<std::string> ancestors1;
-    collectAncestors(commit1, ancestors1, 0);
-    
-    // 使用BFS从commit2开始寻找第一个在ancestors1中的提交
-    std::queue<std::string> queue;
-    std::set<std::string> visited;
-    
-    queue.push(commit2);
-    visited.insert(commit2);
-    
-    while (!queue.empty()) {
-        std::string current = queue.front();
-        queue.pop();
-        
-        if (ancestors1.find(current) != ancestors1.end()) {
-            return current;
-        }
-        
-        if (current.empty() || current == "0") continue;
-        
-        std::string commitPath = objectsDir + "/" + current;
-        if (!Utils::exists(commitPath)) continue;
-        
-        std::string content = Utils::readContentsAsString(commitPath);
-        std::stringstream ss(content);
-        
-        // 跳过消息
-        std::string line;
-        std::getline(ss, line);
-        
-        // 读取父提交
-        std::getline(ss, line);
-        std::string parent1 = line;
-        
-        // 检查是否有第二个父提交
-        std::string parent2 = "";
-        std::getline(ss, line);
-        if (line.find(":") == std::string::npos) {
-            parent2 = line;
-        }
-        
-        // 添加父提交到队列
-        if (!parent1.empty() && parent1 != "0" && visited.find(parent1) == visited.end()) {
-            queue.push(parent1);
-            visited.insert(parent1);
-        }
-        if (!parent2.empty() && parent2 != "0" && visited.find(parent2) == visited.end()) {
-            queue.push(parent2);
-            visited.insert(parent2);
-        }
+    uint32_t index1, index2;
+    if (!lookupCommit(commit1, index1) || !lookupCommit(commit2, index2)) {
+        return "0";
     }
-    
-    return "0"; // 返回初始提交
+    uint32_t base = graph.mergeBase(index1, index2);
+    return base == CommitGraph::NONE ? "0" : graph.id(base);
 }
 
-// 获取提交中的所有文件
-std::map<std::string, std::string> SomeObj::Impl::getCommitFiles(const std::string& commitHash) const {
-    std::map<std::string, std::string> files;
-    
-    if (commitHash.empty() || commitHash == "0") {
-        return files;
-    }
-    
-    std::string commitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(commitPath)) {
-        return files;
-    }
-    
-    std::string content = Utils::readContentsAsString(commitPath);
-    std::stringstream ss(content);
-    
-    // 跳过消息
-    std::string line;
-    std::getline(ss, line);
-    
-    // 跳过父提交（可能有1个或2个）
-    std::getline(ss, line); // 第一个父提交
-    std::getline(ss, line); // 可能是第二个父提交或时间戳
-    
-    // 如果是第二个父提交，再读一行获取时间戳
-    if (line.find(":") == std::string::npos) {
-        std::getline(ss, line); // 时间戳
-    }
-    // 现在line是时间戳
-    
-    int blobCount;
-    ss >> blobCount;
-    
-    for (int i = 0; i < blobCount; ++i) {
-        std::string blobHash, filename;
-        ss >> blobHash >> filename;
-        files[filename] = blobHash;
-    }
-    
-    return files;
+// 获取提交中的所有文件，按路径排序的扁平数组
+Manifest SomeObj::Impl::getCommitFiles(const std::string& commitHash, PathTable& paths) const {
+    return Manifest::of(commits.get(commitHash).get(), paths);
+}
+
+// 两个提交之间内容不同的文件，按路径排序；空 id 表示不存在。
+// 两者都有树时逐层比较，跳过哈希相同的子树；旧格式的提交则归并比较文件列表
+Manifest::Changes SomeObj::Impl::changedFiles(const std::string& fromCommit,
+                                              const std::string& toCommit,
+                                              PathTable& paths) const {
+    Manifest::Changes changes(paths.resource());
+    std::shared_ptr<const Commit> from = commits.get(fromCommit);
+    std::shared_ptr<const Commit> to = commits.get(toCommit);
+    
+    if ((!from || !from->tree().isNull()) && (!to || !to->tree().isNull())) {
+        ObjectId fromTree = from ? from->tree() : ObjectId();
+        ObjectId toTree = to ? to->tree() : ObjectId();
+        Tree::diff(objects, fromTree, toTree, "",
+                   [&changes, &paths](const std::string& path, const ObjectId& a, const ObjectId& b) {
+                       changes.push_back({paths.intern(path), a, b});
+                   });
+        // 树按条目名排序，"a/x" 会排在 "a.txt" 之前，需按完整路径重排
+        std::sort(changes.begin(), changes.end(),
+                  [&paths](const Manifest::Change& a, const Manifest::Change& b) {
+                      return paths.less(a.path, b.path);
+                  });
+        return changes;
+    }
+    
+    Manifest a = Manifest::of(from.get(), paths);
+    Manifest b = Manifest::of(to.get(), paths);
+    Manifest none(&arena);
+    Manifest::join(paths, a, b, none,
+                   [&changes](PathId path, const ObjectId& blobA, const ObjectId& blobB, const ObjectId&) {
+                       if (blobA != blobB) {
+                           changes.push_back({path, blobA, blobB});
+                       }
+                   });
+    return changes;
 }
 
 // 检查两个文件是否相等
@@ -1205,23 +1104,28 @@ bool SomeObj::Impl::filesEqual(const std::string& file1, const std::string& file
 void SomeObj::Impl::checkUntrackedFilesForMerge(const std::string& currentCommit,
                                                const std::string& givenCommit,
                                                const std::string& splitPoint) const {
-    auto splitFiles = getCommitFiles(splitPoint);
-    auto currentFiles = getCommitFiles(currentCommit);
-    auto givenFiles = getCommitFiles(givenCommit);
+    PathTable paths(&arena);
+    Manifest splitFiles = getCommitFiles(splitPoint, paths);
+    Manifest currentFiles = getCommitFiles(currentCommit, paths);
+    Manifest givenFiles = getCommitFiles(givenCommit, paths);
     
     // 检查所有在给定分支中存在但在分割点或当前分支中不存在的文件
-    for (const auto& [filename, hash] : givenFiles) {
-        bool inSplit = (splitFiles.find(filename) != splitFiles.end());
-        bool inCurrent = (currentFiles.find(filename) != currentFiles.end());
+    Manifest::join(paths, splitFiles, currentFiles, givenFiles,
+                   [&](PathId path, const ObjectId& splitHash, const ObjectId& currentHash,
+                       const ObjectId& givenHash) {
+        if (givenHash.isNull()) {
+            return;
+        }
+        std::string filename(paths[path]);
         
         // 如果文件在给定分支中但不在分割点或当前分支中，并且工作目录中存在
-        if ((!inSplit || !inCurrent) && Utils::exists(filename)) {
+        if ((splitHash.isNull() || currentHash.isNull()) && Utils::exists(filename)) {
             // 检查是否未被跟踪（不在暂存区）
             if (stagedFiles.find(filename) == stagedFiles.end()) {
                 Utils::exitWithMessage("There is an untracked file in the way; delete it, or add and commit it first.");
             }
         }
-    }
+    });
 }
 
 // 执行合并操作
@@ -1231,25 +1135,19 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
                                                   const std::string& branchName) {
     std::set<std::string> conflictFiles;
     
-    auto splitFiles = getCommitFiles(splitPoint);
-    auto currentFiles = getCommitFiles(currentCommit);
-    auto givenFiles = getCommitFiles(givenCommit);
-    
-    // 收集所有涉及的文件名
-    std::set<std::string> allFiles;
-    for (const auto& [filename, hash] : splitFiles) allFiles.insert(filename);
-    for (const auto& [filename, hash] : currentFiles) allFiles.insert(filename);
-    for (const auto& [filename, hash] : givenFiles) allFiles.insert(filename);
-    
-    // 遍历所有文件
-    for (const auto& filename : allFiles) {
-        bool inSplit = (splitFiles.find(filename) != splitFiles.end());
-        bool inCurrent = (currentFiles.find(filename) != currentFiles.end());
-        bool inGiven = (givenFiles.find(filename) != givenFiles.end());
-        
-        std::string splitHash = inSplit ? splitFiles[filename] : "";
-        std::string currentHash = inCurrent ? currentFiles[filename] : "";
-        std::string givenHash = inGiven ? givenFiles[filename] : "";
+    PathTable paths(&arena);
+    Manifest splitFiles = getCommitFiles(splitPoint, paths);
+    Manifest currentFiles = getCommitFiles(currentCommit, paths);
+    Manifest givenFiles = getCommitFiles(givenCommit, paths);
+    
+    // 按路径归并三个文件列表，逐个处理涉及的文件
+    Manifest::join(paths, splitFiles, currentFiles, givenFiles,
+                   [&](PathId path, const ObjectId& splitHash, const ObjectId& currentHash,
+                       const ObjectId& givenHash) {
+        std::string filename(paths[path]);
+        bool inSplit = !splitHash.isNull();
+        bool inCurrent = !currentHash.isNull();
+        bool inGiven = !givenHash.isNull();
         
         // 情况1: 在给定分支中被修改，在当前分支中未修改
         if (inSplit && inCurrent && inGiven) {
@@ -1257,7 +1155,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
                 // 从给定分支恢复文件
                 restoreFileFromCommit(givenCommit, filename);
                 add(filename); // 自动暂存
-                continue;
+                return;
             }
         }
         
@@ -1265,7 +1163,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
         if (inSplit && inCurrent && inGiven) {
             if (givenHash == splitHash && currentHash != splitHash) {
                 // 保持当前版本不变
-                continue;
+                return;
             }
         }
         
@@ -1273,7 +1171,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
         if (inSplit && inCurrent && inGiven) {
             if (currentHash == givenHash) {
                 // 文件保持不变
-                continue;
+                return;
             }
         }
         
@@ -1282,13 +1180,13 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
             // 从给定分支恢复文件并暂存
             restoreFileFromCommit(givenCommit, filename);
             add(filename);
-            continue;
+            return;
         }
         
         // 情况5: 仅在当前分支中存在（分割点不存在）
         if (!inSplit && inCurrent && !inGiven) {
             // 保持原样
-            continue;
+            return;
         }
         
         // 情况6: 在分割点存在，在当前分支中未修改，在给定分支中被删除
@@ -1299,7 +1197,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
                     Utils::restrictedDelete(filename);
                 }
                 // 不跟踪该文件
-                continue;
+                return;
             }
         }
         
@@ -1307,7 +1205,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
         if (inSplit && !inCurrent && inGiven) {
             if (givenHash == splitHash) {
                 // 保持不被跟踪和暂存
-                continue;
+                return;
             }
         }
         
@@ -1348,18 +1246,12 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
             std::string currentContent = "";
             std::string givenContent = "";
             
-            if (inCurrent) {
-                std::string blobPath = objectsDir + "/" + currentHash;
-                if (Utils::exists(blobPath)) {
-                    currentContent = Utils::readContentsAsString(blobPath);
-                }
+            if (inCurrent && objects.contains(currentHash)) {
+                currentContent = objects.read(currentHash);
             }
             
-            if (inGiven) {
-                std::string blobPath = objectsDir + "/" + givenHash;
-                if (Utils::exists(blobPath)) {
-                    givenContent = Utils::readContentsAsString(blobPath);
-                }
+            if (inGiven && objects.contains(givenHash)) {
+                givenContent = objects.read(givenHash);
             }
             
             // 创建冲突标记
@@ -1372,7 +1264,7 @@ std::set<std::string> SomeObj::Impl::performMerge(const std::string& currentComm
             Utils::writeContents(filename, conflictContent);
             add(filename); // 自动暂存冲突文件
         }
-    }
+    });
     
     return conflictFiles;
 }
@@ -1407,60 +1299,72 @@ void SomeObj::Impl::merge(const std::string& branchName) {
     
     // 6. 检查特殊情况
     if (splitPoint == givenCommitHash) {
-        std::cout << "Given branch is an ancestor of the current branch." << std::endl;
+        Output::standard() << "Given branch is an ancestor of the current branch.\n";
         return;
     }
     
     if (splitPoint == currentCommitHash) {
         checkoutBranch(branchName);
-        std::cout << "Current branch fast-forwarded." << std::endl;
+        Output::standard() << "Current branch fast-forwarded.\n";
         return;
     }
     
-    // 7. 获取三个提交的文件状态
-    auto splitFiles = getCommitFiles(splitPoint);
-    auto currentFiles = getCommitFiles(currentCommitHash);
-    auto givenFiles = getCommitFiles(givenCommitHash);
+    // 7. 获取三个提交的文件状态：只收集分割点之后至少一侧有变化的文件，
+    //    两侧都未修改的文件无需处理。两份差异都按路径排序，归并成三个扁平文件列表
+    PathTable paths(&arena);
+    Manifest::Changes toCurrent = changedFiles(splitPoint, currentCommitHash, paths);
+    Manifest::Changes toGiven = changedFiles(splitPoint, givenCommitHash, paths);
+    Manifest splitFiles(&arena), currentFiles(&arena), givenFiles(&arena);
+    auto record = [](Manifest& files, PathId path, const ObjectId& hash) {
+        if (!hash.isNull()) {
+            files.add(path, hash);
+        }
+    };
+    size_t i = 0, j = 0;
+    while (i < toCurrent.size() || j < toGiven.size()) {
+        bool takeCurrent = j == toGiven.size() ||
+                           (i < toCurrent.size() && !paths.less(toGiven[j].path, toCurrent[i].path));
+        bool takeGiven = i == toCurrent.size() ||
+                         (j < toGiven.size() && !paths.less(toCurrent[i].path, toGiven[j].path));
+        const Manifest::Change& change = takeCurrent ? toCurrent[i] : toGiven[j];
+        record(splitFiles, change.path, change.from);
+        record(currentFiles, change.path, takeCurrent ? toCurrent[i].to : change.from);
+        record(givenFiles, change.path, takeGiven ? toGiven[j].to : change.from);
+        i += takeCurrent;
+        j += takeGiven;
+    }
     
     // 8. 检查未跟踪文件冲突
-    for (const auto& [filename, hash] : givenFiles) {
-        bool inCurrent = (currentFiles.find(filename) != currentFiles.end());
-        bool inSplit = (splitFiles.find(filename) != splitFiles.end());
-        
+    Manifest::join(paths, splitFiles, currentFiles, givenFiles,
+                   [&](PathId path, const ObjectId& splitHash, const ObjectId& currentHash,
+                       const ObjectId& givenHash) {
         // 如果文件在给定分支中但不在当前提交或分割点中
-        if (!inCurrent || !inSplit) {
+        if (!givenHash.isNull() && (currentHash.isNull() || splitHash.isNull())) {
+            std::string filename(paths[path]);
             // 检查工作目录中是否有未跟踪的同名文件
             if (Utils::exists(filename)) {
                 // 检查是否未被跟踪（不在暂存区）且不被当前提交跟踪
-                if (stagedFiles.find(filename) == stagedFiles.end() && 
-                    currentFiles.find(filename) == currentFiles.end()) {
+                if (stagedFiles.find(filename) == stagedFiles.end() && currentHash.isNull()) {
                     Utils::exitWithMessage("There is an untracked file in the way; delete it, or add and commit it first.");
                 }
             }
         }
-    }
+    });
     
     // 9. 执行合并，跟踪修改和冲突
     bool hasConflict = false;
     
-    // 收集所有涉及的文件
-    std::set<std::string> allFiles;
-    for (const auto& [f, h] : splitFiles) allFiles.insert(f);
-    for (const auto& [f, h] : currentFiles) allFiles.insert(f);
-    for (const auto& [f, h] : givenFiles) allFiles.insert(f);
-    
     // 清空当前暂存区（合并会创建新的暂存状态）
-    std::map<std::string, std::string> newStagedFiles;
+    std::map<std::string, ObjectId> newStagedFiles;
     std::set<std::string> newRemovedFiles;
     
-    for (const auto& filename : allFiles) {
-        bool inSplit = (splitFiles.find(filename) != splitFiles.end());
-        bool inCurrent = (currentFiles.find(filename) != currentFiles.end());
-        bool inGiven = (givenFiles.find(filename) != givenFiles.end());
-        
-        std::string splitHash = inSplit ? splitFiles[filename] : "";
-        std::string currentHash = inCurrent ? currentFiles[filename] : "";
-        std::string givenHash = inGiven ? givenFiles[filename] : "";
+    Manifest::join(paths, splitFiles, currentFiles, givenFiles,
+                   [&](PathId path, const ObjectId& splitHash, const ObjectId& currentHash,
+                       const ObjectId& givenHash) {
+        std::string filename(paths[path]);
+        bool inSplit = !splitHash.isNull();
+        bool inCurrent = !currentHash.isNull();
+        bool inGiven = !givenHash.isNull();
         
         // 情况1: 在给定分支中被修改，在当前分支中未修改
         if (inSplit && inCurrent && inGiven) {
@@ -1468,7 +1372,7 @@ void SomeObj::Impl::merge(const std::string& branchName) {
                 // 从给定分支恢复文件
                 restoreFileFromCommit(givenCommitHash, filename);
                 newStagedFiles[filename] = givenHash;
-                continue;
+                return;
             }
         }
         
@@ -1477,7 +1381,7 @@ void SomeObj::Impl::merge(const std::string& branchName) {
             // 恢复给定分支的版本
             restoreFileFromCommit(givenCommitHash, filename);
             newStagedFiles[filename] = givenHash;
-            continue;
+            return;
         }
         
         // 情况3: 在分割点存在，在当前分支中未修改，在给定分支中被删除
@@ -1488,7 +1392,7 @@ void SomeObj::Impl::merge(const std::string& branchName) {
                     Utils::restrictedDelete(filename);
                 }
                 newRemovedFiles.insert(filename);
-                continue;
+                return;
             }
         }
         
@@ -1496,7 +1400,7 @@ void SomeObj::Impl::merge(const std::string& branchName) {
         if (inSplit && inCurrent && inGiven) {
             if (givenHash == splitHash && currentHash != splitHash) {
                 // 保持当前版本，不需要暂存
-                continue;
+                return;
             }
         }
         
@@ -1504,7 +1408,7 @@ void SomeObj::Impl::merge(const std::string& branchName) {
         if (inSplit && inCurrent && inGiven) {
             if (currentHash == givenHash) {
                 // 文件保持不变
-                continue;
+                return;
             }
         }
         
@@ -1541,18 +1445,12 @@ void SomeObj::Impl::merge(const std::string& branchName) {
             std::string currentContent = "";
             std::string givenContent = "";
             
-            if (inCurrent) {
-                std::string blobPath = objectsDir + "/" + currentHash;
-                if (Utils::exists(blobPath)) {
-                    currentContent = Utils::readContentsAsString(blobPath);
-                }
+            if (inCurrent && objects.contains(currentHash)) {
+                currentContent = objects.read(currentHash);
             }
             
-            if (inGiven) {
-                std::string blobPath = objectsDir + "/" + givenHash;
-                if (Utils::exists(blobPath)) {
-                    givenContent = Utils::readContentsAsString(blobPath);
-                }
+            if (inGiven && objects.contains(givenHash)) {
+                givenContent = objects.read(givenHash);
             }
             
             // 创建冲突标记
@@ -1573,108 +1471,25 @@ void SomeObj::Impl::merge(const std::string& branchName) {
             Utils::writeContents(filename, conflictStr);
             
             // 计算并保存冲突文件的blob
-            std::string conflictHash = Utils::sha1(conflictStr);
-            std::string blobPath = objectsDir + "/" + conflictHash;
-            if (!Utils::exists(blobPath)) {
-                Utils::writeContents(blobPath, conflictStr);
+            ObjectId conflictHash = Utils::sha1Id(conflictStr);
+            if (!objects.contains(conflictHash)) {
+                objects.write(conflictHash, conflictStr);
             }
             
             newStagedFiles[filename] = conflictHash;
         }
-    }
+    });
     
     // 10. 更新暂存区
     stagedFiles = newStagedFiles;
     removedFiles = newRemovedFiles;
     
-    // 11. 创建合并提交（无论是否有冲突）
-    std::string message = "Merged " + branchName + " into " + currentBranch + ".";
-    
-    std::string parentHash = getHeadCommitHash();
-    
-    std::stringstream commitData;
-    commitData << message << "\n";
-    
-    // 写入父提交（两个）
-    if (parentHash.empty() || parentHash == "0") {
-        commitData << "0\n";
-    } else {
-        commitData << parentHash << "\n";
-    }
-    
-    // 第二个父提交
-    commitData << givenCommitHash << "\n";
-    
-    // 时间戳
-    std::time_t now = std::time(nullptr);
-    std::tm* gmt = std::gmtime(&now);
-    char timeBuffer[100];
-    std::strftime(timeBuffer, sizeof(timeBuffer), "%a %b %d %H:%M:%S %Y +0000", gmt);
-    commitData << timeBuffer << "\n";
-    
-    // 收集blob信息
-    std::map<std::string, std::string> blobs;
-    
-    // 从第一个父提交继承blob
-    if (!parentHash.empty() && parentHash != "0") {
-        std::string commitPath = objectsDir + "/" + parentHash;
-        if (Utils::exists(commitPath)) {
-            std::string commitContent = Utils::readContentsAsString(commitPath);
-            std::stringstream ss(commitContent);
-            
-            std::string line;
-            std::getline(ss, line);  // 消息
-            std::getline(ss, line);  // 第一个父提交
-            std::getline(ss, line);  // 第二个父提交或时间戳
-            if (line.find(":") == std::string::npos) {
-                std::getline(ss, line);  // 时间戳
-            }
-            
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, blobFile;
-                ss >> blobHash >> blobFile;
-                blobs[blobFile] = blobHash;
-            }
-        }
-    }
-    
-    // 添加暂存的文件（包括冲突文件）
-    for (const auto& [filename, hash] : stagedFiles) {
-        blobs[filename] = hash;
-    }
-    
-    // 移除标记为删除的文件
-    for (const auto& filename : removedFiles) {
-        blobs.erase(filename);
-    }
-    
-    // 写入blob数量和信息
-    commitData << blobs.size() << "\n";
-    for (const auto& [filename, hash] : blobs) {
-        commitData << hash << " " << filename << "\n";
-    }
-    
-    // 保存提交
-    std::string commitContent = commitData.str();
-    std::string commitHash = Utils::sha1(commitContent);
-    std::string commitPath = objectsDir + "/" + commitHash;
-    Utils::writeContents(commitPath, commitContent);
-    
-    // 更新分支引用
-    std::string branchPath = gitliteDir + "/refs/heads/" + currentBranch;
-    Utils::writeContents(branchPath, commitHash + "\n");
-    
-    // 12. 清空暂存区
-    stagedFiles.clear();
-    removedFiles.clear();
-    saveStaging();
+    // 11. 创建合并提交（无论是否有冲突），同时清空暂存区
+    commit("Merged " + branchName + " into " + currentBranch + ".", givenCommitHash);
     
-    // 13. 处理结果
+    // 12. 处理结果
     if (hasConflict) {
-        std::cout << "Encountered a merge conflict." << std::endl;
+        Output::standard() << "Encountered a merge conflict.\n";
     }
     // 注意：不在merge命令中打印log，log命令会在后续调用时显示
 }
@@ -1702,66 +1517,80 @@ std::string SomeObj::Impl::getRemoteBranchHash(const std::string& remoteName, co
     return content;
 }
 
-void SomeObj::Impl::copyObjectIfNotExists(const std::string& objectHash, const std::string& remoteObjectsDir) const {
-    std::string localObjectPath = objectsDir + "/" + objectHash;
-    std::string remoteObjectPath = remoteObjectsDir + "/" + objectHash;
-    
-    if (!Utils::exists(remoteObjectPath) && Utils::exists(localObjectPath)) {
-        std::string content = Utils::readContentsAsString(localObjectPath);
-        Utils::writeContents(remoteObjectPath, content);
+void SomeObj::Impl::copyObjectIfNotExists(const ObjectId& objectHash, const ObjectStore& remoteObjects,
+                                          Transaction& transaction) const {
+    if (!remoteObjects.contains(objectHash) && objects.contains(objectHash)) {
+        remoteObjects.write(objectHash, objects.read(objectHash));
+        transaction.add(remoteObjects.path(objectHash));
     }
 }
 
-void SomeObj::Impl::copyCommitAndBlobs(const std::string& commitHash, const std::string& remoteObjectsDir) const {
+void SomeObj::Impl::copyCommitAndBlobs(const std::string& commitHash, const ObjectStore& remoteObjects,
+                                       Transaction& transaction) const {
     if (commitHash.empty() || commitHash == "0") {
         return;
     }
     
     // 如果已经存在，直接返回
-    std::string remoteCommitPath = remoteObjectsDir + "/" + commitHash;
-    if (Utils::exists(remoteCommitPath)) {
+    if (remoteObjects.contains(commitHash)) {
         return;
     }
     
     // 复制提交对象
-    std::string localCommitPath = objectsDir + "/" + commitHash;
-    if (!Utils::exists(localCommitPath)) {
+    if (!objects.contains(commitHash)) {
         return;
     }
     
-    std::string commitContent = Utils::readContentsAsString(localCommitPath);
-    Utils::writeContents(remoteCommitPath, commitContent);
-    
-    // 解析提交内容，获取父提交和blobs
-    std::stringstream ss(commitContent);
-    std::string line;
+    std::string commitContent = objects.read(commitHash);
+    remoteObjects.write(commitHash, commitContent);
+    transaction.add(remoteObjects.path(commitHash));
     
-    std::getline(ss, line); // 消息
-    std::getline(ss, line); // 第一个父提交
-    
-    // 复制第一个父提交
-    if (!line.empty() && line != "0") {
-        copyCommitAndBlobs(line, remoteObjectsDir);
+    // 解析提交内容，复制父提交和blobs
+    std::shared_ptr<const Commit> commit = Commit::parse(commitHash, commitContent);
+    if (!commit) {
+        return;
     }
-    
-    // 检查是否有第二个父提交
-    std::getline(ss, line);
-    if (line.find(":") == std::string::npos) {
-        // 这是第二个父提交
-        if (!line.empty() && line != "0") {
-            copyCommitAndBlobs(line, remoteObjectsDir);
+    if (!commit->parent1().empty()) {
+        copyCommitAndBlobs(std::string(commit->parent1()), remoteObjects, transaction);
+    }
+    if (!commit->parent2().empty()) {
+        copyCommitAndBlobs(std::string(commit->parent2()), remoteObjects, transaction);
+    }
+    if (!commit->tree().isNull()) {
+        copyTreeIfNotExists(commit->tree(), objects, remoteObjects, transaction);
+        return;
+    }
+    for (const auto& file : commit->files()) {
+        copyObjectIfNotExists(file.blob, remoteObjects, transaction);
+    }
+}
+
+// 复制一棵树及其引用的 blob。目标已有的子树（及其下的全部对象）直接跳过，
+// 子树先于父树写入
+void SomeObj::Impl::copyTreeIfNotExists(const ObjectId& treeHash, const ObjectStore& source,
+                                        const ObjectStore& target, Transaction& transaction) const {
+    std::vector<ObjectId> trees;
+    std::set<ObjectId> seenTrees;
+    std::set<ObjectId> blobs;
+    Tree::collect(source, treeHash,
+                  [&](const ObjectId& treeId) {
+                      if (target.contains(treeId) || !seenTrees.insert(treeId).second) {
+                          return false;
+                      }
+                      trees.push_back(treeId);
+                      return true;
+                  },
+                  [&](const std::string&, const ObjectId& blob) { blobs.insert(blob); });
+    
+    for (const auto& blob : blobs) {
+        if (!target.contains(blob) && source.contains(blob)) {
+            target.write(blob, source.read(blob));
+            transaction.add(target.path(blob));
         }
-        std::getline(ss, line); // 时间戳
     }
-    
-    // 复制blobs
-    int blobCount;
-    ss >> blobCount;
-    
-    for (int i = 0; i < blobCount; ++i) {
-        std::string blobHash, filename;
-        ss >> blobHash >> filename;
-        copyObjectIfNotExists(blobHash, remoteObjectsDir);
+    for (auto it = trees.rbegin(); it != trees.rend(); ++it) {
+        target.write(*it, source.read(*it));
+        transaction.add(target.path(*it));
     }
 }
 
@@ -1770,53 +1599,11 @@ bool SomeObj::Impl::isAncestor(const std::string& ancestor, const std::string& d
         return true;
     }
     
-    std::queue<std::string> queue;
-    std::set<std::string> visited;
-    
-    queue.push(descendant);
-    visited.insert(descendant);
-    
-    while (!queue.empty()) {
-        std::string current = queue.front();
-        queue.pop();
-        
-        if (current == ancestor) {
-            return true;
-        }
-        
-        if (current.empty() || current == "0") {
-            continue;
-        }
-        
-        std::string commitPath = objectsDir + "/" + current;
-        if (!Utils::exists(commitPath)) {
-            continue;
-        }
-        
-        std::string content = Utils::readContentsAsString(commitPath);
-        std::stringstream ss(content);
-        
-        std::string line;
-        std::getline(ss, line); // 消息
-        std::getline(ss, line); // 第一个父提交
-        
-        if (!line.empty() && line != "0" && visited.find(line) == visited.end()) {
-            queue.push(line);
-            visited.insert(line);
-        }
-        
-        // 检查是否有第二个父提交
-        std::getline(ss, line);
-        if (line.find(":") == std::string::npos) {
-            if (!line.empty() && line != "0" && visited.find(line) == visited.end()) {
-                queue.push(line);
-                visited.insert(line);
-            }
-            std::getline(ss, line); // 时间戳
-        }
+    uint32_t ancestorIndex, descendantIndex;
+    if (!lookupCommit(ancestor, ancestorIndex) || !lookupCommit(descendant, descendantIndex)) {
+        return false;
     }
-    
-    return false;
+    return graph.isAncestor(ancestorIndex, descendantIndex);
 }
 
 // ==================== 远程相关方法 ====================
@@ -1897,11 +1684,14 @@ void SomeObj::Impl::push(const std::string& remoteName, const std::string& branc
     }
     
     // 复制所有必要的对象到远程仓库
-    std::string remoteObjectsDir = remoteGitlitePath + "/objects";
-    copyCommitAndBlobs(localHead, remoteObjectsDir);
-    
-    // 更新远程分支引用
-    Utils::writeContents(remoteBranchPath, localHead + "\n");
+    ObjectStore remoteObjects(remoteGitlitePath + "/objects");
+    remoteObjects.migrateLayout();
+    Transaction transaction(remoteGitlitePath);
+    copyCommitAndBlobs(localHead, remoteObjects, transaction);
+    CommitGraph(remoteObjects).addCommits({localHead});
+    
+    // 对象落盘后再更新远程分支引用
+    transaction.updateRef(remoteBranchPath, localHead);
 }
 
 void SomeObj::Impl::fetch(const std::string& remoteName, const std::string& branchName) {
@@ -1932,9 +1722,11 @@ void SomeObj::Impl::fetch(const std::string& remoteName, const std::string& bran
     }
     
     // 从远程复制所有必要的对象到本地
-    std::string remoteObjectsDir = remoteGitlitePath + "/objects";
+    ObjectStore remoteObjects(remoteGitlitePath + "/objects");
+    remoteObjects.migrateLayout();
     
     // 复制提交及其所有祖先和blobs
+    Transaction transaction(gitliteDir);
     std::queue<std::string> commitsToCopy;
     std::set<std::string> copiedCommits;
     
@@ -1946,58 +1738,45 @@ void SomeObj::Impl::fetch(const std::string& remoteName, const std::string& bran
         commitsToCopy.pop();
         
         // 复制提交对象
-        std::string remoteCommitPath = remoteObjectsDir + "/" + commitHash;
-        std::string localCommitPath = objectsDir + "/" + commitHash;
-        
-        if (Utils::exists(remoteCommitPath) && !Utils::exists(localCommitPath)) {
-            std::string commitContent = Utils::readContentsAsString(remoteCommitPath);
-            Utils::writeContents(localCommitPath, commitContent);
+        if (remoteObjects.contains(commitHash) && !objects.contains(commitHash)) {
+            std::string commitContent = remoteObjects.read(commitHash);
+            objects.write(commitHash, commitContent);
+            transaction.add(objects.path(commitHash));
             
             // 解析提交内容，获取父提交
-            std::stringstream ss(commitContent);
-            std::string line;
-            
-            std::getline(ss, line); // 消息
-            std::getline(ss, line); // 第一个父提交
-            
-            if (!line.empty() && line != "0" && copiedCommits.find(line) == copiedCommits.end()) {
-                commitsToCopy.push(line);
-                copiedCommits.insert(line);
+            std::shared_ptr<const Commit> commit = Commit::parse(commitHash, commitContent);
+            if (!commit) {
+                continue;
             }
             
-            // 检查是否有第二个父提交
-            std::getline(ss, line);
-            if (line.find(":") == std::string::npos) {
-                if (!line.empty() && line != "0" && copiedCommits.find(line) == copiedCommits.end()) {
-                    commitsToCopy.push(line);
-                    copiedCommits.insert(line);
+            for (std::string_view parentView : {commit->parent1(), commit->parent2()}) {
+                std::string parent(parentView);
+                if (!parent.empty() && copiedCommits.insert(parent).second) {
+                    commitsToCopy.push(parent);
                 }
-                std::getline(ss, line); // 时间戳
             }
             
-            // 复制blobs
-            int blobCount;
-            ss >> blobCount;
-            
-            for (int i = 0; i < blobCount; ++i) {
-                std::string blobHash, filename;
-                ss >> blobHash >> filename;
-                
-                std::string remoteBlobPath = remoteObjectsDir + "/" + blobHash;
-                std::string localBlobPath = objectsDir + "/" + blobHash;
-                
-                if (Utils::exists(remoteBlobPath) && !Utils::exists(localBlobPath)) {
-                    std::string blobContent = Utils::readContentsAsString(remoteBlobPath);
-                    Utils::writeContents(localBlobPath, blobContent);
+            // 复制树和blobs
+            if (!commit->tree().isNull()) {
+                copyTreeIfNotExists(commit->tree(), remoteObjects, objects, transaction);
+                continue;
+            }
+            for (const auto& file : commit->files()) {
+                const ObjectId& blobHash = file.blob;
+                if (remoteObjects.contains(blobHash) && !objects.contains(blobHash)) {
+                    objects.write(blobHash, remoteObjects.read(blobHash));
+                    transaction.add(objects.path(blobHash));
                 }
             }
         }
     }
     
+    graph.addCommits({remoteHead});
+    
     // 在本地创建远程分支引用
     std::string localRemoteBranchName = remoteName + "/" + branchName;
     std::string localRemoteBranchPath = gitliteDir + "/refs/heads/" + localRemoteBranchName;
-    Utils::writeContents(localRemoteBranchPath, remoteHead + "\n");
+    transaction.updateRef(localRemoteBranchPath, remoteHead);
 }
 
 void SomeObj::Impl::pull(const std::string& remoteName, const std::string& branchName) {
@@ -2009,6 +1788,84 @@ void SomeObj::Impl::pull(const std::string& remoteName, const std::string& branc
     merge(remoteBranchName);
 }
 
+// ==================== 仓库维护 ====================
+
+// 将所有松散对象打包：提交按时间从新到旧排列，随后是它们引用的树和 blob，
+// 使 log 和 checkout 对打包文件的读取基本是顺序的。
+// 同一路径的旧版本 blob 以较新版本为基准做增量（delta）存储；
+// 同一秒内的提交按代数从高到低排列，保证子提交总在父提交之前。
+// 提交图的增量层也在此时并入基础图
+void SomeObj::Impl::repack() {
+    graph.compact();
+    const CommitGraph& history = commitGraph();
+    std::vector<uint32_t> byTime(history.size());
+    for (uint32_t i = 0; i < history.size(); ++i) {
+        byTime[i] = i;
+    }
+    std::stable_sort(byTime.begin(), byTime.end(), [&](uint32_t a, uint32_t b) {
+        if (history.commitTime(a) != history.commitTime(b)) {
+            return history.commitTime(a) > history.commitTime(b);
+        }
+        return history.generation(a) > history.generation(b);
+    });
+
+    std::vector<ObjectId> order;
+    std::vector<ObjectId> trees;
+    std::vector<ObjectId> blobs;
+    std::set<ObjectId> seenTrees;
+    std::set<ObjectId> seenBlobs;
+    std::map<std::string, ObjectId> newerVersion; // 路径 -> 最近见到的 blob
+    std::map<ObjectId, ObjectId> deltaBases;      // blob -> 增量基准 blob
+    auto visitBlob = [&](const std::string& filename, const ObjectId& blob) {
+        ObjectId& newer = newerVersion[filename];
+        if (seenBlobs.insert(blob).second) {
+            blobs.push_back(blob);
+            if (!newer.isNull()) {
+                deltaBases.emplace(blob, newer);
+            }
+        }
+        newer = blob;
+    };
+    for (uint32_t index : byTime) {
+        order.push_back(history.objectId(index));
+        std::shared_ptr<const Commit> commit = commits.get(history.id(index));
+        if (!commit) {
+            continue;
+        }
+        if (!commit->tree().isNull()) {
+            // 已见过的子树（及其中的 blob）跳过
+            Tree::collect(objects, commit->tree(),
+                          [&](const ObjectId& treeId) {
+                              if (!seenTrees.insert(treeId).second) {
+                                  return false;
+                              }
+                              trees.push_back(treeId);
+                              return true;
+                          },
+                          visitBlob);
+        } else {
+            for (const auto& file : commit->files()) {
+                visitBlob(std::string(file.filename), file.blob);
+            }
+        }
+    }
+    order.insert(order.end(), trees.begin(), trees.end());
+    order.insert(order.end(), blobs.begin(), blobs.end());
+
+    objects.repack(order, deltaBases);
+}
+
+// 启动或停止文件系统监视守护进程
+void SomeObj::Impl::fsmonitor(const std::string& action) {
+    if (action == "--stop") {
+        if (!FsMonitor::stop(gitliteDir)) {
+            Utils::exitWithMessage("No file system monitor is running.");
+        }
+        return;
+    }
+    FsMonitor::start(gitliteDir);
+}
+
 // ==================== SomeObj 公共接口 ====================
 
 SomeObj::SomeObj() : pImpl(std::make_unique<Impl>()) {}
@@ -2016,12 +1873,16 @@ SomeObj::~SomeObj() = default;
 
 void SomeObj::init() { pImpl->init(); }
 void SomeObj::add(const std::string& filename) { pImpl->add(filename); }
+void SomeObj::add(const std::vector<std::string>& paths) { pImpl->add(paths); }
 void SomeObj::commit(const std::string& message) { pImpl->commit(message); }
 void SomeObj::rm(const std::string& filename) { pImpl->rm(filename); }
 void SomeObj::status() { pImpl->status(); }
-void SomeObj::log() { pImpl->log(); }
-void SomeObj::globalLog() { pImpl->globalLog(); }
-void SomeObj::find(const std::string& commitMessage) { pImpl->find(commitMessage); }
+void SomeObj::log(const std::string& format) { pImpl->log(format); }
+void SomeObj::globalLog(size_t limit, std::time_t since, std::time_t until,
+                        const std::string& format) {
+    pImpl->globalLog(limit, since, until, format);
+}
+void SomeObj::find(const std::string& commitMessage, bool substring) { pImpl->find(commitMessage, substring); }
 void SomeObj::checkoutFile(const std::string& filename) { pImpl->checkoutFile(filename); }
 void SomeObj::checkoutFileInCommit(const std::string& commitId, const std::string& filename) { 
     pImpl->checkoutFileInCommit(commitId, filename); 
@@ -2047,4 +1908,8 @@ void SomeObj::fetch(const std::string& remoteName, const std::string& branchName
 }
 void SomeObj::pull(const std::string& remoteName, const std::string& branchName) { 
     pImpl->pull(remoteName, branchName); 
-}
\ No newline at end of file
+}
+
+// 仓库维护
+void SomeObj::repack() { pImpl->repack(); }
+void SomeObj::fsmonitor(const std::string& action) { pImpl->fsmonitor(action); }
@@ -0,0 +1,61 @@
+#include "../include/Transaction.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <set>
+#include <unistd.h>
+
+static std::string parentOf(const std::string& path) {
+    size_t pos = path.find_last_of('/');
+    return (pos == std::string::npos) ? "." : path.substr(0, pos);
+}
+
+/** fsyncs the file or directory PATH.  Missing paths are ignored. */
+static void syncPath(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+Transaction::Transaction(const std::string& repositoryDir) : repositoryDir(repositoryDir) {}
+
+/** Records that PATH must be durable before the next ref update. */
+void Transaction::add(const std::string& path) {
+    paths.push_back(path);
+}
+
+/** Flushes every recorded file, and the directory entries naming them,
+ *  to disk.  A no-op when nothing was recorded. */
+void Transaction::commit() {
+    if (paths.empty()) return;
+#ifdef __linux__
+    int fd = open(repositoryDir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        int result = syncfs(fd);
+        close(fd);
+        if (result == 0) {
+            paths.clear();
+            return;
+        }
+    }
+#endif
+    std::set<std::string> directories;
+    for (const auto& path : paths) {
+        syncPath(path);
+        directories.insert(parentOf(path));
+    }
+    for (const auto& directory : directories) {
+        syncPath(directory);
+    }
+    paths.clear();
+}
+
+/** Commits the batch, then points the ref at REFPATH to COMMITID and
+ *  makes that durable as well. */
+void Transaction::updateRef(const std::string& refPath, const std::string& commitId) {
+    commit();
+    Utils::writeContents(refPath, commitId + "\n");
+    syncPath(refPath);
+    syncPath(parentOf(refPath));
+}
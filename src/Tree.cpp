@@ -0,0 +1,339 @@
+#include "../include/Tree.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+
+/** Calls VISIT(isTree, id, name) for each entry of tree CONTENT, in
+ *  order.  Returns false if CONTENT does not have the tree shape. */
+template <class Visit>
+bool parseEntries(std::string_view content, Visit&& visit) {
+    std::string_view rest(content);
+    auto nextLine = [&rest](std::string_view& line) {
+        if (rest.empty()) return false;
+        size_t end = rest.find('\n');
+        line = rest.substr(0, end);
+        rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+        return true;
+    };
+
+    std::string_view line;
+    if (!nextLine(line)) return false;
+    size_t count = 0;
+    auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), count);
+    if (ec != std::errc() || ptr != line.data() + line.size()) return false;
+
+    std::string_view previous;
+    for (size_t i = 0; i < count; ++i) {
+        if (!nextLine(line) || line.size() < 5 || line[4] != ' ') return false;
+        std::string_view kind = line.substr(0, 4);
+        if (kind != "blob" && kind != "tree") return false;
+        line.remove_prefix(5);
+        ObjectId id;
+        if (line.size() <= ObjectId::HEX_SIZE || line[ObjectId::HEX_SIZE] != ' ' ||
+            !ObjectId::fromHex(line.substr(0, ObjectId::HEX_SIZE), id)) {
+            return false;
+        }
+        std::string_view name = line.substr(ObjectId::HEX_SIZE + 1);
+        if (name.empty() || name.find('/') != std::string_view::npos) return false;
+        if (i > 0 && previous >= name) return false;
+        previous = name;
+        visit(kind == "tree", id, name);
+    }
+    return rest.empty();
+}
+
+/** Appends the files below tree ID to FILES.  PATH holds the prefix and
+ *  is restored before returning. */
+void flattenInto(const ObjectStore& objects, const ObjectId& id, std::pmr::string& path,
+                 Tree::FileList& files) {
+    if (id.isNull()) {
+        return;
+    }
+    std::string content = objects.read(id);
+    size_t base = path.size();
+    bool valid = parseEntries(content, [&](bool isTree, const ObjectId& entryId, std::string_view name) {
+        path.append(name);
+        if (isTree) {
+            path += '/';
+            flattenInto(objects, entryId, path, files);
+        } else {
+            files.emplace_back(path, entryId);
+        }
+        path.resize(base);
+    });
+    if (!valid) {
+        throw std::invalid_argument("malformed tree " + id.hex());
+    }
+}
+
+/** An entry whose name points into the tree's content. */
+struct EntryView {
+    bool isTree;
+    ObjectId id;
+    std::string_view name;
+};
+
+/** Reads tree ID into CONTENT and lists its entries in ENTRIES. */
+void readViews(const ObjectStore& objects, const ObjectId& id, std::string& content,
+               std::vector<EntryView>& entries) {
+    if (id.isNull()) {
+        return;
+    }
+    content = objects.read(id);
+    bool valid = parseEntries(content, [&entries](bool isTree, const ObjectId& entryId,
+                                                  std::string_view name) {
+        entries.push_back({isTree, entryId, name});
+    });
+    if (!valid) {
+        throw std::invalid_argument("malformed tree " + id.hex());
+    }
+}
+
+/** Tree::diff() below the directory in PATH, which is restored before
+ *  returning.  Entry names are views into the tree contents and paths
+ *  are built in PATH, so nothing is allocated per entry. */
+void diffInto(const ObjectStore& objects, const ObjectId& idA, const ObjectId& idB,
+              std::string& path, const Tree::DiffCallback& callback) {
+    if (idA == idB) {
+        return;
+    }
+    std::string contentA, contentB;
+    std::vector<EntryView> a, b;
+    readViews(objects, idA, contentA, a);
+    readViews(objects, idB, contentB, b);
+
+    size_t base = path.size();
+    auto visit = [&](const EntryView& entry, const ObjectId& x, const ObjectId& y) {
+        path.append(entry.name);
+        if (entry.isTree) {
+            path += '/';
+            diffInto(objects, x, y, path, callback);
+        } else {
+            callback(path, x, y);
+        }
+        path.resize(base);
+    };
+    auto onlyA = [&](const EntryView& entry) { visit(entry, entry.id, ObjectId()); };
+    auto onlyB = [&](const EntryView& entry) { visit(entry, ObjectId(), entry.id); };
+
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i].name < b[j].name)) {
+            onlyA(a[i++]);
+        } else if (i == a.size() || b[j].name < a[i].name) {
+            onlyB(b[j++]);
+        } else {
+            const EntryView& x = a[i++];
+            const EntryView& y = b[j++];
+            if (x.isTree == y.isTree) {
+                if (x.id != y.id) visit(x, x.id, y.id);
+            } else {
+                onlyA(x);
+                onlyB(y);
+            }
+        }
+    }
+}
+
+/** Stores tree CONTENT and returns its id, appending it to WRITTEN if
+ *  it was not already in OBJECTS. */
+ObjectId store(const ObjectStore& objects, const std::string& content,
+               std::vector<ObjectId>& written) {
+    ObjectId id = Utils::sha1Id(content);
+    if (!objects.contains(id)) {
+        objects.write(id, content);
+        written.push_back(id);
+    }
+    return id;
+}
+
+} // namespace
+
+/** Parses CONTENT as a tree into ENTRIES.  Returns false if CONTENT does
+ *  not have the tree shape. */
+bool Tree::parse(std::string_view content, Entries& entries) {
+    entries.clear();
+    return parseEntries(content, [&entries](bool isTree, const ObjectId& id, std::string_view name) {
+        entries.push_back({isTree, id, std::string(name)});
+    });
+}
+
+/** Serializes ENTRIES, which must be sorted by name, in the format
+ *  described in Tree.h. */
+std::string Tree::format(const Entries& entries) {
+    std::string out = std::to_string(entries.size()) + "\n";
+    for (const auto& entry : entries) {
+        out += entry.isTree ? "tree " : "blob ";
+        entry.id.appendHex(out);
+        out += ' ';
+        out += entry.name;
+        out += '\n';
+    }
+    return out;
+}
+
+/** Returns the entries of tree ID.  The null id names the empty tree. */
+Tree::Entries Tree::read(const ObjectStore& objects, const ObjectId& id) {
+    Entries entries;
+    if (id.isNull()) {
+        return entries;
+    }
+    if (!parse(objects.read(id), entries)) {
+        throw std::invalid_argument("malformed tree " + id.hex());
+    }
+    return entries;
+}
+
+/** Stores ENTRIES as a tree and returns its id.  Trees that were not
+ *  already in OBJECTS are appended to WRITTEN. */
+ObjectId Tree::write(const ObjectStore& objects, const Entries& entries,
+                     std::vector<ObjectId>& written) {
+    return store(objects, format(entries), written);
+}
+
+typedef std::map<std::string, ObjectId>::const_iterator ChangeIterator;
+
+/** Applies the changes in [BEGIN, END) to tree ID.  Their paths all
+ *  start with the OFFSET bytes naming this tree's directory.  Returns the
+ *  new tree's id, or the null id if it ended up empty.
+ *
+ * All paths below one directory are contiguous in the sorted change map,
+ * so each subdirectory is handed its own subrange, and every name is a
+ * view into either the tree's content or a change path. */
+static ObjectId updateTree(const ObjectStore& objects, const ObjectId& id, ChangeIterator begin,
+                           ChangeIterator end, size_t offset, std::vector<ObjectId>& written) {
+    std::string content;
+    std::vector<EntryView> entries;
+    readViews(objects, id, content, entries);
+
+    // One edit per changed name: a file set or removed, or a subdirectory
+    // with the range of its changes.  Files come before subdirectories.
+    struct Edit {
+        std::string_view name;
+        bool isTree;
+        ObjectId blob;
+        ChangeIterator first, last;
+    };
+    std::vector<Edit> edits;
+    for (ChangeIterator it = begin; it != end;) {
+        std::string_view path = std::string_view(it->first).substr(offset);
+        size_t slash = path.find('/');
+        if (slash == std::string_view::npos) {
+            edits.push_back({path, false, it->second, it, it});
+            ++it;
+            continue;
+        }
+        std::string_view name = path.substr(0, slash);
+        ChangeIterator last = it;
+        while (last != end && last->first.size() > offset + slash &&
+               last->first.compare(offset, slash + 1, it->first, offset, slash + 1) == 0) {
+            ++last;
+        }
+        edits.push_back({name, true, ObjectId(), it, last});
+        it = last;
+    }
+    std::stable_sort(edits.begin(), edits.end(), [](const Edit& a, const Edit& b) {
+        return a.name < b.name || (a.name == b.name && !a.isTree && b.isTree);
+    });
+
+    std::vector<EntryView> result;
+    result.reserve(entries.size() + edits.size());
+    size_t i = 0, k = 0;
+    while (i < entries.size() || k < edits.size()) {
+        if (k == edits.size() || (i < entries.size() && entries[i].name < edits[k].name)) {
+            result.push_back(entries[i++]);
+            continue;
+        }
+        std::string_view name = edits[k].name;
+        bool present = i < entries.size() && entries[i].name == name;
+        EntryView current = present ? entries[i++] : EntryView{false, ObjectId(), name};
+        for (; k < edits.size() && edits[k].name == name; ++k) {
+            const Edit& edit = edits[k];
+            if (!edit.isTree) {
+                current = {false, edit.blob, name};
+                continue;
+            }
+            ObjectId subId = current.isTree ? current.id : ObjectId();
+            ObjectId newId = updateTree(objects, subId, edit.first, edit.last,
+                                        offset + name.size() + 1, written);
+            if (!newId.isNull()) {
+                current = {true, newId, name};
+            } else if (current.isTree) {
+                current.id = ObjectId();
+            }
+        }
+        if (!current.id.isNull()) {
+            result.push_back(current);
+        }
+    }
+
+    if (result.empty()) {
+        return ObjectId();
+    }
+    std::string out = std::to_string(result.size()) + "\n";
+    for (const auto& entry : result) {
+        out += entry.isTree ? "tree " : "blob ";
+        entry.id.appendHex(out);
+        out += ' ';
+        out += entry.name;
+        out += '\n';
+    }
+    return store(objects, out, written);
+}
+
+/** Stores the snapshot FILES (path -> blob) and returns its root tree. */
+ObjectId Tree::build(const ObjectStore& objects, const std::map<std::string, ObjectId>& files,
+                     std::vector<ObjectId>& written) {
+    return update(objects, ObjectId(), files, written);
+}
+
+/** Returns the root tree of snapshot ROOTID with CHANGES (path -> blob,
+ *  null to remove) applied.  Only the trees on changed paths are read
+ *  and rewritten. */
+ObjectId Tree::update(const ObjectStore& objects, const ObjectId& rootId,
+                      const std::map<std::string, ObjectId>& changes,
+                      std::vector<ObjectId>& written) {
+    ObjectId id = updateTree(objects, rootId, changes.begin(), changes.end(), 0, written);
+    return id.isNull() ? write(objects, {}, written) : id;
+}
+
+/** Appends every file below tree ID to FILES as (PREFIX + path, blob),
+ *  in tree order.  Paths are built in one buffer from the allocator of
+ *  FILES, so only the tree objects themselves come from the heap. */
+void Tree::flatten(const ObjectStore& objects, const ObjectId& id, const std::string& prefix,
+                   FileList& files) {
+    std::pmr::string path(prefix, files.get_allocator().resource());
+    flattenInto(objects, id, path, files);
+}
+
+/** Calls CALLBACK(path, blob in A, blob in B) for every file that
+ *  differs between trees IDA and IDB.  Subtrees with equal ids on both
+ *  sides are skipped without being read. */
+void Tree::diff(const ObjectStore& objects, const ObjectId& idA, const ObjectId& idB,
+                const std::string& prefix, const DiffCallback& callback) {
+    std::string path(prefix);
+    diffInto(objects, idA, idB, path, callback);
+}
+
+/** Walks tree ID depth-first.  ENTER is called with each tree id before
+ *  it is read and may return false to skip that subtree; VISITBLOB is
+ *  called with every file in the trees that were entered. */
+void Tree::collect(const ObjectStore& objects, const ObjectId& id,
+                   const std::function<bool(const ObjectId& treeId)>& enter,
+                   const std::function<void(const std::string& path,
+                                            const ObjectId& blob)>& visitBlob,
+                   const std::string& prefix) {
+    if (!enter(id)) {
+        return;
+    }
+    for (const auto& entry : read(objects, id)) {
+        if (entry.isTree) {
+            collect(objects, entry.id, enter, visitBlob, prefix + entry.name + "/");
+        } else {
+            visitBlob(prefix + entry.name, entry.id);
+        }
+    }
+}
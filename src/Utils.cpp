@@ -1,8 +1,15 @@
 #include "../include/Utils.h"
+#include "../include/Output.h"
+#include "../include/Sha1Kernels.h"
 #include <cstdlib>
-#include <iostream>
 #include <sys/stat.h>
 #include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <cstdio>
 
 /** Assorted utilities.
  *
@@ -12,117 +19,122 @@
 
 // SHA1 implementation
 namespace SHA1 {
+    // Compression kernel for this CPU, chosen once at startup.
+    static const CompressFn compress = selectCompress();
+
     void SHA::reset() {
-        A = 0x67452301;
-        B = 0xEFCDAB89;
-        C = 0x98BADCFE;
-        D = 0x10325476;
-        E = 0xC3D2E1F0;
-    }
-    
-    std::string SHA::padding(std::string message) {
-        int originalLength = message.length();
-        int newLength = ((originalLength + 8) + 63) / 64 * 64;
-        std::string newMessage = message;
-        newMessage.resize(newLength, 0);
-        newMessage[originalLength] = static_cast<char>(0x80);
-        int bitLength = originalLength * 8;
-        for(int i = newLength - 1; i >= newLength - 8; i--) {
-            newMessage[i] = bitLength % 256;
-            bitLength /= 256;
-        }
-        return newMessage;
+        state[0] = 0x67452301;
+        state[1] = 0xEFCDAB89;
+        state[2] = 0x98BADCFE;
+        state[3] = 0x10325476;
+        state[4] = 0xC3D2E1F0;
     }
     
-    SHA::WORD SHA::charToWord(char ch) {
-        return (BYTE)ch;
+    SHA::SHA() {
+        init();
     }
     
-    SHA::WORD SHA::shiftLeft(WORD x, int n) {
-        return (x >> (32 - n)) | (x << n);
+    /** Starts a new message, discarding any buffered input. */
+    void SHA::init() {
+        reset();
+        bufferLength = 0;
+        totalLength = 0;
     }
     
-    void SHA::getWord(std::string& message, int index) {
-        for(int i = 0; i < 16; i++) {
-            Word[i] = (charToWord(message[index + 4*i]) << 24) + 
-                     (charToWord(message[index + 4*i + 1]) << 16) + 
-                     (charToWord(message[index + 4*i + 2]) << 8) + 
-                     charToWord(message[index + 4*i + 3]);
+    /** Hashes LENGTH more bytes of the message.  Runs of whole blocks
+     *  are handed to the kernel straight from DATA; only a trailing
+     *  partial block is copied into the internal buffer. */
+    void SHA::update(const void* data, size_t length) {
+        const BYTE* bytes = static_cast<const BYTE*>(data);
+        totalLength += length;
+        
+        if (bufferLength > 0) {
+            size_t take = std::min(length, BLOCK_SIZE - bufferLength);
+            std::memcpy(buffer + bufferLength, bytes, take);
+            bufferLength += take;
+            bytes += take;
+            length -= take;
+            if (bufferLength < BLOCK_SIZE) return;
+            compress(state, buffer, 1);
+            bufferLength = 0;
+        }
+        
+        size_t blocks = length / BLOCK_SIZE;
+        if (blocks > 0) {
+            compress(state, bytes, blocks);
+            bytes += blocks * BLOCK_SIZE;
+            length -= blocks * BLOCK_SIZE;
         }
-        for(int i = 16; i < 80; i++) {
-            Word[i] = shiftLeft(Word[i-3] ^ Word[i-8] ^ Word[i-14] ^ Word[i-16], 1);
+        
+        if (length > 0) {
+            std::memcpy(buffer, bytes, length);
+            bufferLength = length;
         }
     }
     
-    SHA::SHA() : Word(80) {
-        reset();
+    void SHA::update(const std::string& data) {
+        update(data.data(), data.size());
     }
     
-    SHA::WORD SHA::kt(int t) {
-        if (t < 20)
-            return 0x5a827999;
-        else if (t < 40)
-            return 0x6ed9eba1;
-        else if (t < 60)
-            return 0x8f1bbcdc;
-        else
-            return 0xca62c1d6;
+    /** Pads the message (0x80, zeros, 64-bit big-endian bit length),
+     *  returns the digest and leaves the engine ready for reuse. */
+    ObjectId SHA::finalizeId() {
+        uint64_t bitLength = totalLength * 8;
+        
+        buffer[bufferLength++] = 0x80;
+        if (bufferLength > BLOCK_SIZE - 8) {
+            std::memset(buffer + bufferLength, 0, BLOCK_SIZE - bufferLength);
+            compress(state, buffer, 1);
+            bufferLength = 0;
+        }
+        std::memset(buffer + bufferLength, 0, BLOCK_SIZE - 8 - bufferLength);
+        for (int i = 0; i < 8; i++) {
+            buffer[BLOCK_SIZE - 1 - i] = static_cast<BYTE>(bitLength >> (8 * i));
+        }
+        compress(state, buffer, 1);
+        
+        ObjectId id;
+        for (int i = 0; i < 5; i++) {
+            for (int j = 0; j < 4; j++) {
+                id.data()[i * 4 + j] = static_cast<BYTE>(state[i] >> (24 - 8 * j));
+            }
+        }
+        
+        init();
+        return id;
     }
     
-    SHA::WORD SHA::ft(int t, WORD B, WORD C, WORD D) {
-        if (t < 20)
-            return (B & C) | ((~B) & D);
-        else if (t < 40)
-            return B ^ C ^ D;
-        else if (t < 60)
-            return (B & C) | (B & D) | (C & D);
-        else
-            return B ^ C ^ D;
+    std::string SHA::finalize() {
+        return finalizeId().hex();
     }
     
-    std::string SHA::sha(std::string message) {
-        reset();
-        message = padding(message);
-        int byteLength = message.length();
-        for(int i = 0; i < byteLength; i += 64) {
-            getWord(message, i);
-            WORD a = A, b = B, c = C, d = D, e = E;
-            for(int j = 0; j < 80; j++) {
-                WORD temp = shiftLeft(a, 5) + ft(j, b, c, d) + e + kt(j) + Word[j];
-                e = d;
-                d = c;
-                c = shiftLeft(b, 30);
-                b = a;
-                a = temp;
-            }
-            A += a;
-            B += b;
-            C += c;
-            D += d;
-            E += e;
-        }
-        std::stringstream ss;
-        ss << std::hex;
-        ss << std::setw(8) << std::setfill('0') << A;
-        ss << std::setw(8) << std::setfill('0') << B;
-        ss << std::setw(8) << std::setfill('0') << C;
-        ss << std::setw(8) << std::setfill('0') << D;
-        ss << std::setw(8) << std::setfill('0') << E;
-        return ss.str();
+    std::string SHA::sha(const std::string& message) {
+        init();
+        update(message);
+        return finalize();
     }
     
     SHA sha;
     
-    std::string sha1(std::string message) {
+    std::string sha1(const std::string& message) {
         return sha.sha(message);
     }
     
-    std::string sha1(std::string s1, std::string s2) {
-        return sha1(s1 + s2);
+    std::string sha1(const std::string& s1, const std::string& s2) {
+        sha.init();
+        sha.update(s1);
+        sha.update(s2);
+        return sha.finalize();
     }
     
-    std::string sha1(std::string s1, std::string s2, std::string s3, std::string s4) {
-        return sha1(s1 + s2 + s3 + s4);
+    std::string sha1(const std::string& s1, const std::string& s2,
+                     const std::string& s3, const std::string& s4) {
+        sha.init();
+        sha.update(s1);
+        sha.update(s2);
+        sha.update(s3);
+        sha.update(s4);
+        return sha.finalize();
     }
 }
 
@@ -144,29 +156,148 @@ std::string Utils::sha1(const std::string& s1, const std::string& s2,
 
 /** Returns the SHA-1 hash of the concatenation of the strings in VALS. */
 std::string Utils::sha1(const std::vector<unsigned char>& data) {
-    std::string str(data.begin(), data.end());
-    return SHA1::sha1(str);
+    SHA1::SHA hasher;
+    hasher.update(data.data(), data.size());
+    return hasher.finalize();
+}
+
+/** Returns the id of an object holding CONTENT. */
+ObjectId Utils::sha1Id(std::string_view content) {
+    SHA1::SHA hasher;
+    hasher.update(content.data(), content.size());
+    return hasher.finalizeId();
+}
+
+/** Returns the object id of the contents of FILE, hashed straight
+ *  from a MappedFile so large files are never copied.  FILE must
+ *  be a normal file.  Throws IllegalArgumentException in case of
+ *  problems. */
+ObjectId Utils::sha1File(const std::string& filepath) {
+    MappedFile file(filepath);
+    return sha1Id(file.view());
+}
+
+/* MAPPED FILES */
+
+/** Reads exactly LENGTH bytes from FD into DATA. */
+static bool readFully(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/** Opens FILEPATH, which must be a normal file.  Throws
+ *  std::invalid_argument in case of problems. */
+MappedFile::MappedFile(const std::string& filepath) {
+    if (!Utils::isFile(filepath)) {
+        throw std::invalid_argument("must be a normal file");
+    }
+    if (!open(filepath)) {
+        throw std::invalid_argument("cannot open file");
+    }
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapping = other.mapping;
+        length = other.length;
+        buffer = std::move(other.buffer);
+        opened = other.opened;
+        other.mapping = nullptr;
+        other.length = 0;
+        other.opened = false;
+    }
+    return *this;
+}
+
+/** Maps or reads FILEPATH, replacing any previous contents.  Returns
+ *  false (leaving the file closed) if it cannot be opened or read. */
+bool MappedFile::open(const std::string& filepath) {
+    close();
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size >= MAP_THRESHOLD) {
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) return false;
+        mapping = data;
+    } else {
+        buffer.resize(size);
+        bool ok = readFully(fd, &buffer[0], size);
+        ::close(fd);
+        if (!ok) {
+            buffer.clear();
+            return false;
+        }
+    }
+    length = size;
+    opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+        mapping = nullptr;
+    }
+    buffer.clear();
+    length = 0;
+    opened = false;
 }
 
 /* FILE DELETION */
 /** Deletes FILE if it exists and is not a directory.  Returns true
 *  if FILE was deleted, and false otherwise.  Refuses to delete FILE
 *  and throws IllegalArgumentException unless the directory designated by
-*  FILE also contains a directory named .gitlite. */
+*  FILE, or one of the directories enclosing it, contains a directory
+*  named .gitlite.  Directories left empty between FILE and that working
+*  tree root are removed as well. */
 bool Utils::restrictedDelete(const std::string& filepath) {
-    // Extract parent directory
-    size_t pos = filepath.find_last_of("/\\");
-    std::string parentDir = (pos == std::string::npos) ? "." : filepath.substr(0, pos);
-    std::string gitliteDir = parentDir + "/.gitlite";
-
-    if (!isDirectory(gitliteDir)) {
-        throw std::invalid_argument("not .gitlite working directory");
+    // Walk up to the working tree root
+    std::vector<std::string> parents;
+    std::string parentDir = filepath;
+    for (;;) {
+        size_t pos = parentDir.find_last_of("/\\");
+        parentDir = (pos == std::string::npos) ? "." : parentDir.substr(0, pos);
+        if (isDirectory(parentDir + "/.gitlite")) {
+            break;
+        }
+        if (parentDir == "." || parentDir.empty()) {
+            throw std::invalid_argument("not .gitlite working directory");
+        }
+        parents.push_back(parentDir);
     }
     
-    if (isFile(filepath)) {
-        return remove(filepath.c_str()) == 0;
+    if (!isFile(filepath) || remove(filepath.c_str()) != 0) {
+        return false;
+    }
+    for (const auto& dir : parents) {
+        if (rmdir(dir.c_str()) != 0) {
+            break;
+        }
     }
-    return false;
+    return true;
 }
 
  /* READING AND WRITING FILE CONTENTS */
@@ -174,67 +305,84 @@ bool Utils::restrictedDelete(const std::string& filepath) {
  *  be a normal file.  Throws IllegalArgumentException
  *  in case of problems. */
 std::vector<unsigned char> Utils::readContents(const std::string& filepath) {
+    MappedFile file(filepath);
+    return std::vector<unsigned char>(file.bytes(), file.bytes() + file.size());
+}
+
+/** Return the entire contents of FILE as a String.  FILE must
+ *  be a normal file.  Throws IllegalArgumentException
+ *  in case of problems. */
+std::string Utils::readContentsAsString(const std::string& filepath) {
     if (!isFile(filepath)) {
         throw std::invalid_argument("must be a normal file");
     }
-    
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
         throw std::invalid_argument("cannot open file");
     }
-    
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    std::vector<unsigned char> contents(size);
-    file.read(reinterpret_cast<char*>(contents.data()), size);
-    
+
+    // Read straight into the result: the only copy is the kernel's.
+    std::string contents(static_cast<size_t>(st.st_size), '\0');
+    bool ok = readFully(fd, &contents[0], contents.size());
+    ::close(fd);
+    if (!ok) {
+        throw std::invalid_argument("cannot read file");
+    }
     return contents;
 }
 
-/** Return the entire contents of FILE as a String.  FILE must
- *  be a normal file.  Throws IllegalArgumentException
- *  in case of problems. */
-std::string Utils::readContentsAsString(const std::string& filepath) {
-    auto contents = readContents(filepath);
-    return std::string(contents.begin(), contents.end());
+/** Writes LENGTH bytes from DATA to FD. */
+static bool writeFully(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
 }
 
 /** Write the result of concatenating the bytes in CONTENTS to FILE,
- *  creating or overwriting it as needed.  Each object in CONTENTS may be
- *  either a String or a byte array.  Throws IllegalArgumentException
- *  in case of problems. */
-void Utils::writeContents(const std::string& filepath, const std::string& content) {
+ *  creating or overwriting it as needed.  The bytes go to a temporary
+ *  file next to FILE that is then renamed over it, so readers (and a
+ *  crash) see either the old or the new contents, never a partial
+ *  file.  Nothing is fsync'd here; see Transaction for durability.
+ *  Throws IllegalArgumentException in case of problems. */
+void Utils::writeContents(const std::string& filepath, std::string_view content) {
     // Create parent directories if needed
     size_t pos = filepath.find_last_of("/\\");
     if (pos != std::string::npos) {
         std::string parentDir = filepath.substr(0, pos);
         createDirectories(parentDir);
     }
-    
-    std::ofstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
+
+    static std::atomic<unsigned> sequence{0};
+    std::string tmpPath = filepath + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(sequence++);
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
         throw std::invalid_argument("cannot create file");
     }
-    
-    file.write(content.c_str(), content.size());
+    bool ok = writeFully(fd, content.data(), content.size());
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || std::rename(tmpPath.c_str(), filepath.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        throw std::invalid_argument("cannot write file");
+    }
 }
 
 void Utils::writeContents(const std::string& filepath, const std::vector<unsigned char>& content) {
-    // Create parent directories if needed
-    size_t pos = filepath.find_last_of("/\\");
-    if (pos != std::string::npos) {
-        std::string parentDir = filepath.substr(0, pos);
-        createDirectories(parentDir);
-    }
-    
-    std::ofstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::invalid_argument("cannot create file");
-    }
-    
-    file.write(reinterpret_cast<const char*>(content.data()), content.size());
+    writeContents(filepath, std::string_view(reinterpret_cast<const char*>(content.data()), content.size()));
+}
+
+/** Copy the contents of SOURCE to TARGET straight from a mapped view of
+ *  SOURCE, creating or overwriting TARGET as needed.  Throws IllegalArgumentException
+ *  in case of problems. */
+void Utils::copyContents(const std::string& source, const std::string& target) {
+    MappedFile in(source);
+    writeContents(target, in.view());
 }
 
 /** Returns a list of the names of all plain files in the directory DIR, in
@@ -260,6 +408,25 @@ std::vector<std::string> Utils::plainFilenamesIn(const std::string& dirPath) {
     return files;
 }
 
+/** Returns true if PATH contains shell wildcard characters. */
+bool Utils::isGlobPattern(const std::string& path) {
+    return path.find_first_of("*?[") != std::string::npos;
+}
+
+/** Returns the sorted list of paths matching the shell wildcard PATTERN,
+ *  or an empty list if nothing matches. */
+std::vector<std::string> Utils::expandGlob(const std::string& pattern) {
+    std::vector<std::string> matches;
+    glob_t result;
+    if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+        for (size_t i = 0; i < result.gl_pathc; ++i) {
+            matches.push_back(result.gl_pathv[i]);
+        }
+    }
+    globfree(&result);
+    return matches;
+}
+
 /* OTHER FILE UTILITIES */
 
 /** Return the concatenation of FIRST and SECOND into a File path,
@@ -286,11 +453,12 @@ std::vector<unsigned char> Utils::serialize(const std::string& obj) {
 /** Print a message composed from MSG and ARGS as for the String.format
  *  method, followed by a newline. */
 void Utils::message(const std::string& msg) {
-    std::cout << msg << std::endl;
+    Output::standard() << msg << '\n';
 }
 
 void Utils::exitWithMessage(const std::string& msg) {
     message(msg);
+    Output::standard().flush();
     std::exit(0);
 }
 
@@ -0,0 +1,327 @@
+#include "../include/WorkTree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+/** One worker's share of a scan: the directories it has found but not
+ *  yet listed, and the files it has found so far.  With a cache, also
+ *  the directories it visited and the listings it had to read. */
+struct Lane {
+    std::mutex mutex;
+    std::deque<std::string> directories;
+    std::vector<std::string> files;
+    std::vector<std::string> visited;
+    std::vector<std::pair<std::string, WorkTree::Listing>> fresh;
+};
+
+/** What listDirectory() needs to consult and refresh the cache. */
+struct CacheContext {
+    const WorkTree::DirectoryCache* cache;
+    int64_t startNs;
+};
+
+int64_t nanoseconds(const struct timespec& time) {
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+enum class EntryKind { OTHER, FILE, DIRECTORY };
+
+/** Classifies NAME in directory FD from its d_type, falling back to
+ *  fstatat() when the filesystem does not report one.  Symlinks count
+ *  as files when they point at one and are never followed into. */
+EntryKind classify(int fd, const char* name, unsigned char type) {
+    if (type == DT_REG) return EntryKind::FILE;
+    if (type == DT_DIR) return EntryKind::DIRECTORY;
+    struct stat st;
+    if (type == DT_UNKNOWN) {
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return EntryKind::OTHER;
+        if (S_ISREG(st.st_mode)) return EntryKind::FILE;
+        if (S_ISDIR(st.st_mode)) return EntryKind::DIRECTORY;
+        if (!S_ISLNK(st.st_mode)) return EntryKind::OTHER;
+    } else if (type != DT_LNK) {
+        return EntryKind::OTHER;
+    }
+    if (fstatat(fd, name, &st, 0) == 0 && S_ISREG(st.st_mode)) return EntryKind::FILE;
+    return EntryKind::OTHER;
+}
+
+/** Calls VISIT(name, d_type) for every entry of directory FD. */
+template <class Visit>
+void readDirectory(int fd, Visit&& visit) {
+#ifdef __linux__
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+    alignas(8) char buffer[32 * 1024];
+    for (;;) {
+        long bytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (bytes <= 0) return;
+        for (long pos = 0; pos < bytes;) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + pos);
+            pos += entry->d_reclen;
+            visit(entry->d_name, entry->d_type);
+        }
+    }
+#else
+    int copy = dup(fd);
+    DIR* dir = copy < 0 ? nullptr : fdopendir(copy);
+    if (dir == nullptr) {
+        if (copy >= 0) close(copy);
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        visit(entry->d_name, entry->d_type);
+    }
+    closedir(dir);
+#endif
+}
+
+/** Adds the entries of LISTING, a listing of RELATIVE, to LANE.
+ *  Subdirectories are pushed onto LANE's deque and counted into
+ *  OUTSTANDING before anyone can steal them. */
+void publish(const std::string& relative, const WorkTree::Listing& listing, Lane& lane,
+             std::atomic<size_t>& outstanding) {
+    if (listing.nestedRepository && !relative.empty()) return;
+    std::string prefix = relative.empty() ? "" : relative + "/";
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    for (const auto& name : listing.files) {
+        lane.files.push_back(prefix + name);
+    }
+    outstanding += listing.directories.size();
+    for (const auto& name : listing.directories) {
+        lane.directories.push_back(prefix + name);
+    }
+}
+
+/** Lists directory RELATIVE (below ROOTFD) into LANE, from CONTEXT's
+ *  cache when its listing is still current. */
+void listDirectory(int rootFd, const std::string& relative, Lane& lane,
+                   std::atomic<size_t>& outstanding, const CacheContext* context) {
+    const char* path = relative.empty() ? "." : relative.c_str();
+    WorkTree::Listing listing;
+    bool statted = false;
+    if (context != nullptr) {
+        struct stat st;
+        statted = fstatat(rootFd, path, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        if (statted) {
+            listing.mtimeNs = nanoseconds(st.st_mtim);
+            listing.ctimeNs = nanoseconds(st.st_ctim);
+            listing.inode = static_cast<uint64_t>(st.st_ino);
+            auto it = context->cache->listings.find(relative);
+            if (it != context->cache->listings.end() && it->second.mtimeNs == listing.mtimeNs &&
+                it->second.ctimeNs == listing.ctimeNs && it->second.inode == listing.inode) {
+                publish(relative, it->second, lane, outstanding);
+                std::lock_guard<std::mutex> lock(lane.mutex);
+                lane.visited.push_back(relative);
+                return;
+            }
+        }
+    }
+
+    int fd = openat(rootFd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) return;
+    readDirectory(fd, [&](const char* name, unsigned char type) {
+        if (name[0] == '.') {
+            if (std::string_view(name) == ".gitlite") listing.nestedRepository = true;
+            return;
+        }
+        switch (classify(fd, name, type)) {
+        case EntryKind::FILE: listing.files.push_back(name); break;
+        case EntryKind::DIRECTORY: listing.directories.push_back(name); break;
+        case EntryKind::OTHER: break;
+        }
+    });
+    close(fd);
+    if (listing.nestedRepository && !relative.empty()) {
+        listing.files.clear();
+        listing.directories.clear();
+    }
+
+    publish(relative, listing, lane, outstanding);
+    if (statted && listing.mtimeNs < context->startNs && listing.ctimeNs < context->startNs) {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.visited.push_back(relative);
+        lane.fresh.emplace_back(relative, std::move(listing));
+    }
+}
+
+/** Takes the next directory for lane SELF: the newest from its own
+ *  deque, or else the oldest from another lane's. */
+bool takeDirectory(std::vector<std::unique_ptr<Lane>>& lanes, size_t self, std::string& directory) {
+    {
+        Lane& own = *lanes[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.directories.empty()) {
+            directory = std::move(own.directories.back());
+            own.directories.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < lanes.size(); ++k) {
+        Lane& victim = *lanes[(self + k) % lanes.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.directories.empty()) {
+            directory = std::move(victim.directories.front());
+            victim.directories.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+/** Returns every trackable file below DIRECTORY, sorted, as paths
+ *  relative to the current directory ("dir/sub/file"; just "file" when
+ *  DIRECTORY is "."), listing directories on THREADCOUNT workers. */
+std::vector<std::string> WorkTree::scan(const std::string& directory, size_t threadCount,
+                                        DirectoryCache* cache) {
+    std::string root = normalize(directory);
+    if (root.empty()) return {};
+    int rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0) return {};
+    CacheContext context = {cache, timestampClock()};
+    const CacheContext* useCache = (cache != nullptr && root == ".") ? &context : nullptr;
+
+    size_t laneCount = std::max<size_t>(threadCount, 1);
+    std::vector<std::unique_ptr<Lane>> lanes;
+    for (size_t i = 0; i < laneCount; ++i) {
+        lanes.push_back(std::make_unique<Lane>());
+    }
+    lanes[0]->directories.push_back("");
+
+    // Directories queued or being listed; the scan is done at zero.
+    std::atomic<size_t> outstanding(1);
+    auto work = [&](size_t self) {
+        std::string relative;
+        while (outstanding.load() != 0) {
+            if (!takeDirectory(lanes, self, relative)) {
+                std::this_thread::yield();
+                continue;
+            }
+            listDirectory(rootFd, relative, *lanes[self], outstanding, useCache);
+            outstanding -= 1;
+        }
+    };
+
+    if (laneCount == 1) {
+        work(0);
+    } else {
+        ThreadPool pool(laneCount);
+        for (size_t i = 0; i < laneCount; ++i) {
+            pool.submit([&work, i]() { work(i); });
+        }
+        pool.wait();
+    }
+    close(rootFd);
+
+    std::vector<std::string> files;
+    for (auto& lane : lanes) {
+        files.insert(files.end(), std::make_move_iterator(lane->files.begin()),
+                     std::make_move_iterator(lane->files.end()));
+    }
+    if (useCache != nullptr) {
+        // Keep exactly the listings of the directories visited this time.
+        std::map<std::string, Listing> listings;
+        size_t reused = 0;
+        for (auto& lane : lanes) {
+            for (auto& [path, listing] : lane->fresh) {
+                listings[path] = std::move(listing);
+            }
+            cache->changed = cache->changed || !lane->fresh.empty();
+        }
+        for (auto& lane : lanes) {
+            for (const auto& path : lane->visited) {
+                if (listings.count(path) != 0) continue;
+                listings[path] = std::move(cache->listings[path]);
+                ++reused;
+            }
+        }
+        cache->changed = cache->changed || reused != cache->listings.size();
+        cache->listings = std::move(listings);
+    }
+    if (root != ".") {
+        for (auto& file : files) {
+            file = root + "/" + file;
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/** Returns the trackable files at PATH: PATH itself if it is a file, the
+ *  scan() of it if it is a directory other than a nested repository, and
+ *  nothing if it is gone or would be skipped by a scan of the root. */
+std::vector<std::string> WorkTree::scanPath(const std::string& path, size_t threadCount) {
+    std::string normalized = normalize(path);
+    if (normalized.empty()) return {};
+    if (normalized == ".") return scan(".", threadCount);
+    if (normalized[0] == '.' || normalized.find("/.") != std::string::npos) return {};
+
+    size_t slash = normalized.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : normalized.substr(0, slash);
+    std::string name = normalized.substr(slash + 1);
+    int fd = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return {};
+    EntryKind kind = classify(fd, name.c_str(), DT_UNKNOWN);
+    bool nestedRepository = kind == EntryKind::DIRECTORY &&
+                            faccessat(fd, (name + "/.gitlite").c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0;
+    close(fd);
+
+    if (kind == EntryKind::FILE) return {normalized};
+    if (kind == EntryKind::DIRECTORY && !nestedRepository) return scan(normalized, threadCount);
+    return {};
+}
+
+/** Returns PATH in canonical tracked form: relative, '/'-separated,
+ *  with no "." components or repeated separators ("./a//b/" -> "a/b").
+ *  The root itself is ".".  Returns "" for paths that are absolute or
+ *  climb out of the root with "..". */
+std::string WorkTree::normalize(const std::string& path) {
+    if (!path.empty() && path[0] == '/') return "";
+    std::string result;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) end = path.size();
+        std::string_view part(path.data() + start, end - start);
+        if (part == "..") return "";
+        if (!part.empty() && part != ".") {
+            if (!result.empty()) result += '/';
+            result.append(part);
+        }
+        start = end + 1;
+    }
+    return result.empty() ? "." : result;
+}
+
+/** Reads the clock file timestamps are taken from.  A file or directory
+ *  modified after this reading gets an mtime no smaller than it. */
+int64_t WorkTree::timestampClock() {
+    struct timespec now;
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    return nanoseconds(now);
+}